@@ -62,6 +62,18 @@ RBOOT_TWO_ROMS  = 0
 RBOOT_SPIFFS_0  = 0x100000
 RBOOT_SPIFFS_1  = 0x300000 
 
+# raw flash log of the last color (ColorStorage), shared by both roms: the
+# gap between the end of spiffs 0 and rom 1 (0x202000)
+COLOR_LOG_ADDR    ?= 0x1F0000
+COLOR_LOG_SECTORS ?= 4
+ifneq ($(shell echo $$(( $(COLOR_LOG_ADDR) < $(RBOOT_SPIFFS_0) + $(SPIFF_SIZE) ))), 0)
+$(error COLOR_LOG_ADDR $(COLOR_LOG_ADDR) overlaps spiffs 0 ($(RBOOT_SPIFFS_0) + $(SPIFF_SIZE)))
+endif
+ifneq ($(shell echo $$(( $(COLOR_LOG_ADDR) + $(COLOR_LOG_SECTORS) * 4096 > 0x202000 ))), 0)
+$(error color log at $(COLOR_LOG_ADDR) with $(COLOR_LOG_SECTORS) sectors overlaps rom 1 (0x202000))
+endif
+USER_CFLAGS += -DCOLOR_LOG_ADDR=$(COLOR_LOG_ADDR) -DCOLOR_LOG_SECTORS=$(COLOR_LOG_SECTORS)
+
 ENABLE_CUSTOM_PWM = 0
 #ENABLE_CUSTOM_PWM = 0
 ## output file for first rom (.bin will be appended)
@@ -73,5 +85,12 @@ ENABLE_CUSTOM_PWM = 0
 
 SMING_RELEASE = 1
 
+# on-device benchmarks and the tick profiler (/system cmds "benchmark" and "tick_profile").
+# They block the LED tick while running, keep them out of release images
+ENABLE_BENCHMARK ?= 0
+ifeq ($(ENABLE_BENCHMARK), 1)
+	USER_CFLAGS += -DENABLE_BENCHMARK=1
+endif
+
 # 3 = DEBUG (maximum, don't go higher!)
 DEBUG_VERBOSE_LEVEL = 2
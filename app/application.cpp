@@ -26,6 +26,7 @@ Application app;
 
 // Sming Framework INIT method - called during boot
 void GDB_IRAM_ATTR init() {
+    app.boottimeline.begin();
 
     Serial.begin(SERIAL_BAUD_RATE); // 115200 by default
     Serial.systemDebugOutput(true); // Debug output to serial
@@ -68,6 +69,7 @@ void Application::init() {
 
     // mount filesystem
     mountfs(getRomSlot());
+    boottimeline.mark(BootTimeline::PhaseMountFs);
 
     // check if we need to reset settings
     if (digitalRead(CLEAR_PIN) < 1) {
@@ -78,6 +80,7 @@ void Application::init() {
 
     // check ota
     ota.checkAtBoot();
+    boottimeline.mark(BootTimeline::PhaseOtaCheck);
 
     // load config
     if (cfg.exist()) {
@@ -87,19 +90,25 @@ void Application::init() {
         _first_run = true;
         cfg.save();
     }
+    boottimeline.mark(BootTimeline::PhaseConfig);
 
     mqttclient.init();
+    boottimeline.mark(BootTimeline::PhaseMqtt);
 
     // initialize led ctrl
     rgbwwctrl.init();
+    boottimeline.mark(BootTimeline::PhaseLedCtrl);
 
     initButtons();
+    boottimeline.mark(BootTimeline::PhaseButtons);
 
     // initialize networking
     network.init();
+    boottimeline.mark(BootTimeline::PhaseNetwork);
 
     // initialize webserver
     app.webserver.init();
+    boottimeline.mark(BootTimeline::PhaseWebServer);
 }
 
 void Application::initButtons() {
@@ -132,11 +141,14 @@ void Application::initButtons() {
 // Will be called when system initialization was completed
 void Application::startServices() {
     debug_i("Application::startServices");
+    boottimeline.mark(BootTimeline::PhaseSystemReady);
     rgbwwctrl.start();
+    boottimeline.mark(BootTimeline::PhaseLedStart);
     webserver.start();
 
     if (cfg.events.server_enabled)
         eventserver.start();
+    boottimeline.mark(BootTimeline::PhaseServices);
 }
 
 void Application::restart() {
@@ -191,12 +203,14 @@ void Application::mountfs(int slot) {
         spiffs_mount_manual(RBOOT_SPIFFS_1, SPIFF_SIZE);
     }
     _fs_mounted = true;
+    webassets.build();
 }
 
 void Application::umountfs() {
     debug_i("Application::umountfs");
     spiffs_unmount();
     _fs_mounted = false;
+    webassets.clear();
 }
 
 void Application::switchRom() {
@@ -221,6 +235,30 @@ void Application::onCommandRelay(const String& method, const JsonObject& params)
     mqttclient.publishCommand(method, params);
 }
 
+void Application::onCommandRelay(const String& method, const char* pParams, size_t length) {
+    if (!cfg.sync.cmd_master_enabled)
+        return;
+
+    mqttclient.publishCommand(method, pParams, length);
+}
+
+void Application::onCommandRelay(const String& method, const char* pParams, size_t length, uint32_t atStep) {
+    if (!cfg.sync.cmd_master_enabled)
+        return;
+
+    mqttclient.publishScheduledCommand(method, pParams, length, atStep);
+}
+
+bool Application::getCommandStartStep(uint32_t& step) const {
+    // slaves can only follow the start step if they get our clock
+    if (!cfg.sync.cmd_master_enabled || !cfg.sync.clock_master_enabled || cfg.sync.cmd_master_lead_ms <= 0)
+        return false;
+
+    const int leadSteps = cfg.sync.cmd_master_lead_ms / RGBWW_MINTIMEDIFF;
+    step = rgbwwctrl.getStepCounter() + (leadSteps > 0 ? leadSteps : 1);
+    return true;
+}
+
 void Application::onButtonTogglePressed(int pin) {
     unsigned long now = millis();
     unsigned long diff = now - _lastToggles[pin];
@@ -0,0 +1,641 @@
+#include <RGBWWCtrl.h>
+
+#ifdef ENABLE_BENCHMARK
+
+namespace {
+    const int numIterations = 200;
+
+    // typical payloads of /color and of the relayed MQTT commands
+    const char* jsonParserSamples[] = {
+        "{\"hsv\":{\"h\":120,\"s\":100,\"v\":80,\"ct\":2700},\"t\":1500,\"cmd\":\"fade\",\"q\":\"back\",\"d\":1}",
+        "{\"raw\":{\"r\":1023,\"g\":512,\"b\":0,\"ww\":\"+10\",\"cw\":0,\"from\":{\"r\":0,\"g\":0,\"b\":0}},\"s\":100,\"cmd\":\"fade\",\"name\":\"sunrise\"}",
+        "{\"hsv\":{\"h\":\"+30\",\"v\":50},\"t\":0,\"q\":\"single\",\"channels\":[\"h\",\"v\"],\"r\":true}",
+    };
+
+    // synthetic MQTT broker delays (ms) of clock messages: mostly ~10 ms with
+    // occasional long stalls, made up to exercise the outlier handling, not
+    // recorded on a real network. Pass "profile" for measured delays
+    const uint16_t brokerJitterProfile[] = {
+        12, 9, 15, 11, 250, 10, 13, 8, 480, 12, 10, 14, 9, 11, 320, 10,
+        18, 9, 12, 95, 11, 10, 13, 700, 9, 12, 10, 16, 11, 140, 10, 12,
+    };
+
+    const int maxProfileDelays = 64;
+
+    // scratch copy of the JSON settings for the boot comparison
+    const char* const benchJsonFile = "bench.json";
+
+    // request mix of the webapp and of home automation systems polling the API
+    enum class ResponseKind {
+        Color,
+        Success,
+        Error,
+        ErrorMessage,
+        Ping,
+    };
+
+    const ResponseKind responseMix[] = {
+        ResponseKind::Color, ResponseKind::Success, ResponseKind::Color, ResponseKind::Ping, ResponseKind::Color,
+        ResponseKind::Success, ResponseKind::Error, ResponseKind::Color, ResponseKind::ErrorMessage, ResponseKind::Success,
+    };
+
+    const char* responseErrorMessage = "could not parse HTTP body";
+
+    // the responses as built before the ResponseArena
+    IDataSourceStream* createJsonResponse(ResponseKind kind) {
+        JsonObjectStream* stream = new JsonObjectStream();
+        JsonObject& json = stream->getRoot();
+        switch (kind) {
+        case ResponseKind::Color: {
+            JsonObject& raw = json.createNestedObject("raw");
+            ChannelOutput output = app.rgbwwctrl.getCurrentOutput();
+            raw["r"] = output.r;
+            raw["g"] = output.g;
+            raw["b"] = output.b;
+            raw["ww"] = output.ww;
+            raw["cw"] = output.cw;
+
+            JsonObject& hsv = json.createNestedObject("hsv");
+            float h, s, v;
+            int ct;
+            HSVCT c = app.rgbwwctrl.getCurrentColor();
+            c.asRadian(h, s, v, ct);
+            hsv["h"] = h;
+            hsv["s"] = s;
+            hsv["v"] = v;
+            hsv["ct"] = ct;
+            break;
+        }
+        case ResponseKind::Success:
+            json["success"] = true;
+            break;
+        case ResponseKind::Error:
+            json["error"] = app.webserver.getApiCodeMsg(API_CODES::API_BAD_REQUEST);
+            break;
+        case ResponseKind::ErrorMessage:
+            json["error"] = String(responseErrorMessage);
+            break;
+        case ResponseKind::Ping:
+            json["ping"] = "pong";
+            break;
+        }
+        return stream;
+    }
+
+    IDataSourceStream* createArenaResponse(ResponseKind kind) {
+        switch (kind) {
+        case ResponseKind::Color:
+            return app.webserver.createColorResponse();
+        case ResponseKind::Success:
+            return app.webserver.createApiCodeResponse(API_CODES::API_SUCCESS);
+        case ResponseKind::Error:
+            return app.webserver.createApiCodeResponse(API_CODES::API_BAD_REQUEST);
+        case ResponseKind::ErrorMessage:
+            return app.webserver.createApiCodeResponse(API_CODES::API_BAD_REQUEST, responseErrorMessage);
+        default:
+            return ApplicationWebserver::createPingResponse();
+        }
+    }
+
+    // read the body in chunks like the webserver does, returns its length
+    int drainResponse(IDataSourceStream* stream) {
+        char chunk[64];
+        int length = 0;
+        while (!stream->isFinished()) {
+            const uint16_t len = stream->readMemoryBlock(chunk, sizeof(chunk));
+            if (len == 0)
+                break;
+            stream->seek(len);
+            length += len;
+        }
+        return length;
+    }
+
+    size_t getLargestFreeBlock() {
+        size_t low = 0;
+        size_t high = system_get_free_heap_size();
+        while (low < high) {
+            const size_t mid = (low + high + 1) / 2;
+            void* p = malloc(mid);
+            if (p) {
+                free(p);
+                low = mid;
+            }
+            else {
+                high = mid - 1;
+            }
+        }
+        return low;
+    }
+
+    // float formatting is not available in printf
+    void printSteps(float value) {
+        const int hundredths = lroundf(value * 100);
+        const int absHundredths = abs(hundredths);
+        Serial.printf("%s%d.%02d", hundredths < 0 ? "-" : "", absHundredths / 100, absHundredths % 100);
+    }
+}
+
+void Benchmark::Result::add(uint32_t cycles) {
+    ++count;
+    sum += cycles;
+    minCycles = std::min(minCycles, cycles);
+    maxCycles = std::max(maxCycles, cycles);
+}
+
+void Benchmark::Result::print(const char* label) const {
+    const uint32_t mhz = system_get_cpu_freq();
+    const uint32_t mean = count > 0 ? static_cast<uint32_t>(sum / count) : 0;
+    Serial.printf("  %-10s %10u %10u %10u | %8u %8u | %6u\n", label, mean, minCycles, maxCycles, mean / mhz, maxCycles / mhz, heapUsed);
+}
+
+bool Benchmark::run(const String& name) {
+    debug_i("Benchmark::run: %s", name.c_str());
+    if (name == "json_parser") {
+        runJsonParser();
+        return true;
+    }
+    else if (name == "binary_command") {
+        runBinaryCommand();
+        return true;
+    }
+    else if (name == "color_format") {
+        runColorFormat();
+        return true;
+    }
+    else if (name == "step_sync") {
+        runStepSync();
+        return true;
+    }
+    else if (name == "sync_sim") {
+        runSyncSim();
+        return true;
+    }
+    else if (name == "settings") {
+        runSettings();
+        return true;
+    }
+    else if (name == "responses") {
+        runResponses();
+        return true;
+    }
+    return false;
+}
+
+void Benchmark::runJsonParser() {
+    Serial.printf("Benchmark json_parser: %d iterations @ %d MHz\n", numIterations, system_get_cpu_freq());
+
+    JsonProcessor& proc = app.jsonproc;
+    const int numSamples = sizeof(jsonParserSamples) / sizeof(jsonParserSamples[0]);
+    for (int s=0; s < numSamples; ++s) {
+        const char* pJson = jsonParserSamples[s];
+        const size_t length = strlen(pJson);
+        Result dom;
+        Result pull;
+
+        for (int i=0; i < numIterations; ++i) {
+            uint32_t start = TickProfiler::getCycleCount();
+            {
+                DynamicJsonBuffer jsonBuffer;
+                JsonObject& root = jsonBuffer.parseObject(pJson);
+                JsonProcessor::RequestParameters params;
+                proc.parseRequestParams(root, params);
+            }
+            dom.add(TickProfiler::getCycleCount() - start);
+
+            start = TickProfiler::getCycleCount();
+            {
+                JsonPullParser parser(pJson, length);
+                JsonProcessor::RequestParameters params;
+                if (parser.next() == JsonPullParser::Token::ObjectStart)
+                    proc.parseRequestParams(parser, params);
+            }
+            pull.add(TickProfiler::getCycleCount() - start);
+
+            WDT.alive();
+        }
+
+        // heap in use while the parsed representation is alive
+        uint32_t heapBefore = system_get_free_heap_size();
+        {
+            DynamicJsonBuffer jsonBuffer;
+            JsonObject& root = jsonBuffer.parseObject(pJson);
+            JsonProcessor::RequestParameters params;
+            proc.parseRequestParams(root, params);
+            dom.heapUsed = heapBefore - system_get_free_heap_size();
+        }
+
+        heapBefore = system_get_free_heap_size();
+        {
+            JsonPullParser parser(pJson, length);
+            JsonProcessor::RequestParameters params;
+            if (parser.next() == JsonPullParser::Token::ObjectStart)
+                proc.parseRequestParams(parser, params);
+            pull.heapUsed = heapBefore - system_get_free_heap_size();
+        }
+
+        Serial.printf(" sample %d (%d bytes)\n", s, length);
+        Serial.printf("  %-10s %10s %10s %10s | %8s %8s | %6s\n", "parser", "mean", "min", "max", "mean_us", "max_us", "heap");
+        dom.print("dom");
+        pull.print("pull");
+    }
+}
+
+void Benchmark::runBinaryCommand() {
+    Serial.printf("Benchmark binary_command: %d iterations @ %d MHz\n", numIterations, system_get_cpu_freq());
+
+    // slave side cost of a relayed command: JSON-RPC vs. binary encoding
+    JsonProcessor& proc = app.jsonproc;
+    const int numSamples = sizeof(jsonParserSamples) / sizeof(jsonParserSamples[0]);
+    for (int s=0; s < numSamples; ++s) {
+        const char* pParams = jsonParserSamples[s];
+        String rpcMsg = "{\"jsonrpc\":\"2.0\",\"method\":\"color\",\"params\":";
+        rpcMsg += pParams;
+        rpcMsg += "}";
+
+        String binMsg;
+        if (!BinaryCommand::encode("color", pParams, strlen(pParams), binMsg)) {
+            Serial.printf(" sample %d: not representable in binary\n", s);
+            continue;
+        }
+
+        Result json;
+        Result binary;
+        for (int i=0; i < numIterations; ++i) {
+            uint32_t start = TickProfiler::getCycleCount();
+            {
+                JsonPullParser parser(rpcMsg.c_str(), rpcMsg.length());
+                JsonProcessor::RequestParameters params;
+                parser.next();
+                while (parser.next() == JsonPullParser::Token::Key) {
+                    if (parser.textEquals("params")) {
+                        if (parser.next() == JsonPullParser::Token::ObjectStart)
+                            proc.parseRequestParams(parser, params);
+                        break;
+                    }
+                    parser.skipValue();
+                }
+            }
+            json.add(TickProfiler::getCycleCount() - start);
+
+            start = TickProfiler::getCycleCount();
+            {
+                BinaryCommand::Method method;
+                Vector<BinaryCommand::Record> records;
+                JsonProcessor::RequestParameters params;
+                if (BinaryCommand::decode(binMsg, method, records) && records.count() > 0)
+                    proc.applyRecord(records[0], params);
+            }
+            binary.add(TickProfiler::getCycleCount() - start);
+
+            WDT.alive();
+        }
+
+        Serial.printf(" sample %d (json-rpc %d bytes, binary %d bytes)\n", s, rpcMsg.length(), binMsg.length());
+        Serial.printf("  %-10s %10s %10s %10s | %8s %8s | %6s\n", "format", "mean", "min", "max", "mean_us", "max_us", "heap");
+        json.print("json-rpc");
+        binary.print("binary");
+    }
+}
+
+void Benchmark::runColorFormat() {
+    Serial.printf("Benchmark color_format: %d iterations @ %d MHz\n", numIterations, system_get_cpu_freq());
+
+    // walk through a range of colors, formatting the MQTT color master payload both ways
+    Result floatPath;
+    Result fixedPath;
+    HSVCT color;
+    for (int i=0; i < numIterations; ++i) {
+        color.h = (i * 97) % (RGBWW_CALC_HUEWHEELMAX + 1);
+        color.s = (i * 31) % (RGBWW_CALC_MAXVAL + 1);
+        color.v = RGBWW_CALC_MAXVAL - (i * 13) % (RGBWW_CALC_MAXVAL + 1);
+        color.ct = 2700;
+
+        String floatMsg;
+        uint32_t start = TickProfiler::getCycleCount();
+        {
+            float h, s, v;
+            int ct;
+            color.asRadian(h, s, v, ct);
+
+            DynamicJsonBuffer jsonBuffer(200);
+            JsonObject& root = jsonBuffer.createObject();
+            JsonObject& hsv = root.createNestedObject("hsv");
+            hsv["h"] = h;
+            hsv["s"] = s;
+            hsv["v"] = v;
+            hsv["ct"] = ct;
+            root["t"] = 0;
+            root["cmd"] = "solid";
+            root.printTo(floatMsg);
+        }
+        floatPath.add(TickProfiler::getCycleCount() - start);
+
+        char buf[ColorJson::maxHsvLength + 32];
+        start = TickProfiler::getCycleCount();
+        {
+            char* p = ColorJson::writeString(buf, "{\"hsv\":");
+            p = ColorJson::writeHsv(p, color);
+            p = ColorJson::writeString(p, ",\"t\":0,\"cmd\":\"solid\"}");
+            *p = '\0';
+        }
+        fixedPath.add(TickProfiler::getCycleCount() - start);
+
+        if (i < 3) {
+            Serial.printf("  float: %s\n", floatMsg.c_str());
+            Serial.printf("  fixed: %s\n", buf);
+        }
+
+        WDT.alive();
+    }
+
+    Serial.printf("  %-10s %10s %10s %10s | %8s %8s | %6s\n", "format", "mean", "min", "max", "mean_us", "max_us", "heap");
+    floatPath.print("float");
+    fixedPath.print("fixed");
+}
+
+void Benchmark::runStepSync() {
+    Serial.printf("Benchmark step_sync: master interval %d s\n", app.cfg.sync.clock_master_interval);
+    Serial.printf("  %-8s %6s %8s %5s | %8s %10s %10s\n", "algo", "drift", "jitter", "ts", "conv_s", "mean_off", "max_off");
+
+    const int drifts[] = {0, 100, -300};
+    for (int d=0; d < 3; ++d) {
+        for (int variant=0; variant < 4; ++variant) {
+            const bool withJitter = variant & 1;
+            SyncSimulator::Config cfg;
+            cfg.driftPpm = drifts[d];
+            cfg.masterIntervalS = app.cfg.sync.clock_master_interval;
+            cfg.timestamps = variant & 2;
+            if (withJitter) {
+                cfg.pDelaysMs = brokerJitterProfile;
+                cfg.numDelays = sizeof(brokerJitterProfile) / sizeof(brokerJitterProfile[0]);
+            }
+
+            ClockCatchUp catchUp;
+            ClockPIServo piServo;
+            StepSync* algos[] = {&catchUp, &piServo};
+            const char* names[] = {"catchup", "pi"};
+            for (int a=0; a < 2; ++a) {
+                const SyncSimulator::Result r = SyncSimulator::run(*algos[a], cfg);
+                // float formatting is not available in printf
+                Serial.printf("  %-8s %6d %8s %5s | %8d %7d.%02d %7d.%02d\n", names[a], cfg.driftPpm, withJitter ? "profile" : "none",
+                        cfg.timestamps ? "yes" : "no", r.convergenceS, int(r.meanAbsOffset), int(r.meanAbsOffset * 100) % 100,
+                        int(r.maxAbsOffset), int(r.maxAbsOffset * 100) % 100);
+                WDT.alive();
+            }
+        }
+    }
+}
+
+void Benchmark::runSyncSim() {
+    SyncSimulator::Config cfg;
+    cfg.masterIntervalS = app.cfg.sync.clock_master_interval;
+    cfg.pDelaysMs = brokerJitterProfile;
+    cfg.numDelays = sizeof(brokerJitterProfile) / sizeof(brokerJitterProfile[0]);
+    String algo = "pi";
+    bool trace = false;
+    uint16_t profile[maxProfileDelays];
+
+    DynamicJsonBuffer jsonBuffer;
+    String json;
+    if (fileExist(SYNC_SIM_FILE))
+        json = fileGetContent(SYNC_SIM_FILE);
+    JsonObject& root = jsonBuffer.parseObject(json);
+    if (root.success()) {
+        if (root["algo"].success())
+            algo = root["algo"].asString();
+        if (root["slaves"].success())
+            cfg.numSlaves = root["slaves"];
+        if (root["drift"].success())
+            cfg.driftPpm = root["drift"];
+        if (root["drift_spread"].success())
+            cfg.driftSpreadPpm = root["drift_spread"];
+        if (root["interval"].success())
+            cfg.masterIntervalS = max(root["interval"].as<int>(), 1);
+        if (root["duration"].success())
+            cfg.durationS = root["duration"];
+        if (root["delay"] == "uniform")
+            cfg.delayModel = SyncSimulator::DelayModel::Uniform;
+        else if (root["delay"] == "exponential")
+            cfg.delayModel = SyncSimulator::DelayModel::Exponential;
+        if (root["delay_min_ms"].success())
+            cfg.delayMinMs = root["delay_min_ms"];
+        if (root["delay_mean_ms"].success())
+            cfg.delayMeanMs = root["delay_mean_ms"];
+        if (root["loss"].success())
+            cfg.lossPercent = root["loss"];
+        if (root["timestamps"].success())
+            cfg.timestamps = root["timestamps"];
+        if (root["seed"].success())
+            cfg.seed = root["seed"];
+        if (root["trace"].success())
+            trace = root["trace"];
+
+        JsonArray& delays = root["profile"].asArray();
+        if (delays.success() && delays.size() > 0) {
+            cfg.numDelays = std::min(static_cast<int>(delays.size()), maxProfileDelays);
+            for (int i=0; i < cfg.numDelays; ++i)
+                profile[i] = delays[i];
+            cfg.pDelaysMs = profile;
+        }
+    }
+
+    cfg.numSlaves = std::min(std::max(cfg.numSlaves, 1), static_cast<int>(SyncSimulator::maxSlaves));
+
+    Serial.printf("Benchmark sync_sim: algo %s | slaves %d | drift %d +- %d ppm | interval %d s | duration %d s\n",
+            algo.c_str(), cfg.numSlaves, cfg.driftPpm, cfg.driftSpreadPpm, cfg.masterIntervalS, cfg.durationS);
+    Serial.printf("  delay model %d | min %d ms | mean %d ms | profile %d values | loss %d %% | timestamps %d\n",
+            static_cast<int>(cfg.delayModel), cfg.delayMinMs, cfg.delayMeanMs, cfg.numDelays, cfg.lossPercent, cfg.timestamps);
+
+    StepSync* slaves[SyncSimulator::maxSlaves];
+    for (int i=0; i < cfg.numSlaves; ++i) {
+        if (algo == "catchup")
+            slaves[i] = new ClockCatchUp();
+        else
+            slaves[i] = new ClockPIServo();
+    }
+
+    if (trace) {
+        Serial.print("time_s");
+        for (int i=0; i < cfg.numSlaves; ++i)
+            Serial.printf(",slave%d", i);
+        Serial.println();
+    }
+
+    const SyncSimulator::Result r = SyncSimulator::run(slaves, cfg,
+            trace ? SyncSimulator::TraceDelegate(&Benchmark::printSyncTrace) : SyncSimulator::TraceDelegate());
+
+    Serial.printf("  syncs %d | lost %d | convergence %d s | mean offset ", r.numSyncs, r.numLost, r.convergenceS);
+    printSteps(r.meanAbsOffset);
+    Serial.print(" | max offset ");
+    printSteps(r.maxAbsOffset);
+    Serial.print(" | max spread ");
+    printSteps(r.maxSpread);
+    Serial.println(" (steps)");
+
+    for (int i=0; i < cfg.numSlaves; ++i)
+        delete slaves[i];
+}
+
+void Benchmark::printSyncTrace(int timeS, const float* pOffsets, int numSlaves) {
+    Serial.print(timeS);
+    for (int i=0; i < numSlaves; ++i) {
+        Serial.print(',');
+        printSteps(pOffsets[i]);
+    }
+    Serial.println();
+    WDT.alive();
+}
+
+void Benchmark::runSettings() {
+    Serial.printf("Benchmark settings: %d iterations @ %d MHz\n", numIterations, system_get_cpu_freq());
+
+    // the current settings in both formats, file access is not measured
+    String json;
+    {
+        DynamicJsonBuffer jsonBuffer;
+        JsonObject& root = jsonBuffer.createObject();
+        app.cfg.exportJson(root);
+        root.printTo(json);
+    }
+
+    const int numSections = SettingsStore::numSections;
+    uint8_t* pBinary = new uint8_t[numSections * SettingsStore::maxSectionSize];
+    size_t offsets[numSections + 1];
+    offsets[0] = 0;
+    for (int i=0; i < numSections; ++i) {
+        SettingsStore::Writer writer(pBinary + offsets[i], SettingsStore::maxSectionSize);
+        app.cfg.visitSection(SettingsStore::sections[i], writer);
+        offsets[i + 1] = offsets[i] + writer.getLength();
+    }
+
+    Result jsonPath;
+    Result binaryPath;
+    for (int i=0; i < numIterations; ++i) {
+        uint32_t start = TickProfiler::getCycleCount();
+        {
+            ApplicationSettings cfg;
+            DynamicJsonBuffer jsonBuffer;
+            JsonObject& root = jsonBuffer.parseObject(json);
+            cfg.importJson(root);
+        }
+        jsonPath.add(TickProfiler::getCycleCount() - start);
+
+        start = TickProfiler::getCycleCount();
+        {
+            ApplicationSettings cfg;
+            for (int s=0; s < numSections; ++s) {
+                SettingsStore::Reader reader(pBinary + offsets[s], offsets[s + 1] - offsets[s]);
+                cfg.visitSection(SettingsStore::sections[s], reader);
+            }
+        }
+        binaryPath.add(TickProfiler::getCycleCount() - start);
+
+        WDT.alive();
+    }
+
+    // peak heap of a load: the whole parsed JSON tree vs. the biggest section buffer
+    uint32_t heapBefore = system_get_free_heap_size();
+    {
+        String copy = json;
+        DynamicJsonBuffer jsonBuffer;
+        jsonBuffer.parseObject(copy);
+        jsonPath.heapUsed = heapBefore - system_get_free_heap_size();
+    }
+
+    size_t maxSection = 0;
+    for (int s=0; s < numSections; ++s)
+        maxSection = std::max(maxSection, offsets[s + 1] - offsets[s]);
+    heapBefore = system_get_free_heap_size();
+    {
+        uint8_t* pSection = new uint8_t[maxSection];
+        binaryPath.heapUsed = heapBefore - system_get_free_heap_size();
+        delete[] pSection;
+    }
+
+    // what boot pays: the same, including reading the file. The JSON file of
+    // an older firmware is gone after the migration, a copy is written for this
+    Result jsonBoot;
+    Result binaryBoot;
+    fileSetContent(benchJsonFile, json);
+    for (int i=0; i < numIterations; ++i) {
+        uint32_t start = TickProfiler::getCycleCount();
+        {
+            ApplicationSettings cfg;
+            String content = fileGetContent(benchJsonFile);
+            DynamicJsonBuffer jsonBuffer;
+            JsonObject& root = jsonBuffer.parseObject(content);
+            cfg.importJson(root);
+        }
+        jsonBoot.add(TickProfiler::getCycleCount() - start);
+
+        start = TickProfiler::getCycleCount();
+        {
+            ApplicationSettings cfg;
+            SettingsStore::load(cfg);
+        }
+        binaryBoot.add(TickProfiler::getCycleCount() - start);
+
+        WDT.alive();
+    }
+    fileDelete(benchJsonFile);
+
+    Serial.printf("  size: json %d bytes | binary %d bytes + %d bytes table\n", json.length(), offsets[numSections],
+            sizeof(SettingsStore::FileHeader) + numSections * sizeof(SettingsStore::SectionEntry));
+    Serial.printf("  %-10s %10s %10s %10s | %8s %8s | %6s\n", "load", "mean", "min", "max", "mean_us", "max_us", "heap");
+    jsonPath.print("json");
+    binaryPath.print("binary");
+    jsonBoot.print("json_file");
+    binaryBoot.print("bin_file");
+
+    delete[] pBinary;
+}
+
+void Benchmark::runResponses() {
+    const int numRequests = numIterations * 5;
+    Serial.printf("Benchmark responses: %d requests @ %d MHz\n", numRequests, system_get_cpu_freq());
+
+    // Allocations of the connections outlive the response they were made next to,
+    // as the TCP buffers of a keep-alive connection do. Whatever the responses
+    // free in between ends up as holes.
+    const int numConnectionBlocks = 4;
+    const int numMix = sizeof(responseMix) / sizeof(responseMix[0]);
+    const char* labels[] = { "json", "arena" };
+    Result results[2];
+    size_t largestBlock[2];
+    uint32_t freeHeap[2];
+
+    for (int path=0; path < 2; ++path) {
+        Result& result = results[path];
+        void* connectionBlocks[numConnectionBlocks] = {nullptr};
+        for (int i=0; i < numRequests; ++i) {
+            const ResponseKind kind = responseMix[i % numMix];
+            const uint32_t heapBefore = system_get_free_heap_size();
+            const uint32_t start = TickProfiler::getCycleCount();
+            IDataSourceStream* stream = path == 0 ? createJsonResponse(kind) : createArenaResponse(kind);
+            drainResponse(stream);
+            result.add(TickProfiler::getCycleCount() - start);
+            result.heapUsed = std::max(result.heapUsed, heapBefore - system_get_free_heap_size());
+
+            void*& pBlock = connectionBlocks[i % numConnectionBlocks];
+            free(pBlock);
+            pBlock = malloc(200 + (i * 37) % 400);
+            delete stream;
+
+            WDT.alive();
+        }
+
+        largestBlock[path] = getLargestFreeBlock();
+        freeHeap[path] = system_get_free_heap_size();
+        for (int i=0; i < numConnectionBlocks; ++i)
+            free(connectionBlocks[i]);
+    }
+
+    Serial.printf("  %-10s %10s %10s %10s | %8s %8s | %6s\n", "response", "mean", "min", "max", "mean_us", "max_us", "heap");
+    for (int path=0; path < 2; ++path)
+        results[path].print(labels[path]);
+    for (int path=0; path < 2; ++path)
+        Serial.printf("  %-10s free heap %6u | largest block %6u\n", labels[path], freeHeap[path], largestBlock[path]);
+}
+
+#endif // ENABLE_BENCHMARK
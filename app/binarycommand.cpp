@@ -0,0 +1,422 @@
+#include <RGBWWCtrl.h>
+
+namespace {
+    const char* const hsvComponents[] = {"h", "s", "v", "ct"};
+    const char* const rawComponents[] = {"r", "g", "b", "ww", "cw"};
+    const char* const channelNames[] = {"h", "s", "v", "ct"};
+
+    // largest integer part which still fits int32 after scaling
+    const int32_t maxIntegerPart = INT32_MAX / BinaryCommand::fixedPointScale - 1;
+}
+
+BinaryCommand::Method BinaryCommand::getMethod(const String& name) {
+    if (name == "color")
+        return Method::Color;
+    else if (name == "direct")
+        return Method::Direct;
+    else if (name == "stop")
+        return Method::Stop;
+    else if (name == "skip")
+        return Method::Skip;
+    else if (name == "pause")
+        return Method::Pause;
+    else if (name == "continue")
+        return Method::Continue;
+    else if (name == "blink")
+        return Method::Blink;
+    else if (name == "toggle")
+        return Method::Toggle;
+    return Method::Invalid;
+}
+
+bool BinaryCommand::parseFixedPoint(const char* pText, size_t length, int32_t& value, bool& relative) {
+    // [+-]digits[.digits] - anything else (exponents, words) is left to JSON
+    size_t i = 0;
+
+    bool negative = false;
+    relative = false;
+    if (i < length && (pText[i] == '+' || pText[i] == '-')) {
+        negative = pText[i] == '-';
+        relative = true;
+        ++i;
+    }
+
+    const size_t intStart = i;
+    int32_t intPart = 0;
+    for (; i < length && isdigit(pText[i]); ++i) {
+        intPart = intPart * 10 + (pText[i] - '0');
+        if (intPart > maxIntegerPart)
+            return false;
+    }
+    if (i == intStart)
+        return false;
+
+    // two fractional digits (fixedPointScale), rounded on the third
+    int32_t fraction = 0;
+    if (i < length && pText[i] == '.') {
+        ++i;
+        int digits = 0;
+        for (; i < length && isdigit(pText[i]); ++i, ++digits) {
+            const int digit = pText[i] - '0';
+            if (digits < 2)
+                fraction = fraction * 10 + digit;
+            else if (digits == 2 && digit >= 5)
+                ++fraction;
+        }
+        if (digits == 1)
+            fraction *= 10;
+    }
+    if (i != length)
+        return false;
+
+    value = intPart * fixedPointScale + fraction;
+    if (negative)
+        value = -value;
+    return true;
+}
+
+bool BinaryCommand::parseGroup(JsonPullParser& parser, Record& record, int group) {
+    const bool hsv = (group == GroupHsv || group == GroupHsvFrom);
+    const char* const* pNames = hsv ? hsvComponents : rawComponents;
+    const int numNames = hsv ? 4 : 5;
+
+    for (;;) {
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            return true;
+        if (t != JsonPullParser::Token::Key)
+            return false;
+
+        if (parser.textEquals("from") && (group == GroupHsv || group == GroupRaw)) {
+            if (parser.next() != JsonPullParser::Token::ObjectStart)
+                return false;
+            record.present[group] |= fromBit;
+            if (!parseGroup(parser, record, group + 1))
+                return false;
+            continue;
+        }
+
+        int component = -1;
+        for (int i=0; i < numNames; ++i) {
+            if (parser.textEquals(pNames[i])) {
+                component = i;
+                break;
+            }
+        }
+        if (component < 0)
+            return false;
+
+        t = parser.next();
+        if (t != JsonPullParser::Token::String && t != JsonPullParser::Token::Primitive)
+            return false;
+
+        bool isRelative;
+        if (!parseFixedPoint(parser.getText(), parser.getTextLength(), record.values[group][component], isRelative))
+            return false;
+
+        record.present[group] |= (1 << component);
+        if (isRelative)
+            record.relative[group] |= (1 << component);
+        else
+            record.relative[group] &= ~(1 << component);
+    }
+}
+
+bool BinaryCommand::parseRecord(JsonPullParser& parser, Record& record) {
+    for (;;) {
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            return true;
+        if (t != JsonPullParser::Token::Key)
+            return false;
+
+        if (parser.textEquals("hsv") || parser.textEquals("raw")) {
+            const bool hsv = parser.textEquals("hsv");
+            if (parser.next() != JsonPullParser::Token::ObjectStart)
+                return false;
+            record.flags |= hsv ? FlagHsv : FlagRaw;
+            if (!parseGroup(parser, record, hsv ? GroupHsv : GroupRaw))
+                return false;
+            continue;
+        }
+
+        if (parser.textEquals("channels")) {
+            if (parser.next() != JsonPullParser::Token::ArrayStart)
+                return false;
+            while ((t = parser.next()) != JsonPullParser::Token::ArrayEnd) {
+                if (t != JsonPullParser::Token::String && t != JsonPullParser::Token::Primitive)
+                    return false;
+                for (int i=0; i < 4; ++i) {
+                    if (parser.textEquals(channelNames[i]))
+                        record.channels |= (1 << i);
+                }
+            }
+            continue;
+        }
+
+        const bool isT = parser.textEquals("t");
+        const bool isS = parser.textEquals("s");
+        const bool isR = parser.textEquals("r");
+        const bool isD = parser.textEquals("d");
+        const bool isName = parser.textEquals("name");
+        const bool isCmd = parser.textEquals("cmd");
+        const bool isQ = parser.textEquals("q");
+        if (!isT && !isS && !isR && !isD && !isName && !isCmd && !isQ)
+            return false;
+
+        t = parser.next();
+        if (t != JsonPullParser::Token::String && t != JsonPullParser::Token::Primitive)
+            return false;
+
+        if (isT || isS) {
+            bool isRelative;
+            if (!parseFixedPoint(parser.getText(), parser.getTextLength(), record.ramp, isRelative) || isRelative)
+                return false;
+            record.flags |= FlagRamp;
+            if (isS)
+                record.flags |= FlagSpeed;
+            else
+                record.flags &= ~FlagSpeed;
+        }
+        else if (isR) {
+            if (parser.getInt() == 1)
+                record.flags |= FlagRequeue;
+            else
+                record.flags &= ~FlagRequeue;
+        }
+        else if (isD) {
+            const int direction = parser.getInt();
+            if (direction < INT8_MIN || direction > INT8_MAX)
+                return false;
+            record.direction = direction;
+            record.flags |= FlagDirection;
+        }
+        else if (isName) {
+            record.name = parser.getString();
+            if (record.name.length() > 255)
+                return false;
+            record.flags |= FlagName;
+        }
+        else if (isCmd) {
+            if (parser.textEquals("fade"))
+                record.flags |= FlagFade;
+            else if (parser.textEquals("solid"))
+                record.flags &= ~FlagFade;
+            else
+                return false;
+        }
+        else if (isQ) {
+            if (parser.textEquals("single"))
+                record.queue = QueueSingle;
+            else if (parser.textEquals("back"))
+                record.queue = QueueBack;
+            else if (parser.textEquals("front"))
+                record.queue = QueueFront;
+            else if (parser.textEquals("front_reset"))
+                record.queue = QueueFrontReset;
+            else
+                return false;
+        }
+    }
+}
+
+void BinaryCommand::putByte(String& out, uint8_t b) {
+    if (b == 0x00 || b == 0x01) {
+        out += static_cast<char>(0x01);
+        out += static_cast<char>(b + 1);
+    }
+    else {
+        out += static_cast<char>(b);
+    }
+}
+
+void BinaryCommand::putInt32(String& out, int32_t value) {
+    const uint32_t v = value;
+    putByte(out, v & 0xFF);
+    putByte(out, (v >> 8) & 0xFF);
+    putByte(out, (v >> 16) & 0xFF);
+    putByte(out, (v >> 24) & 0xFF);
+}
+
+void BinaryCommand::writeRecord(const Record& record, String& out) {
+    putByte(out, record.flags);
+    putByte(out, record.queue);
+    putByte(out, record.channels);
+    if (record.flags & FlagDirection)
+        putByte(out, static_cast<uint8_t>(record.direction));
+    if (record.flags & FlagRamp)
+        putInt32(out, record.ramp);
+
+    for (int group=0; group < GroupCount; ++group) {
+        // from groups are only written if the parent says so
+        if (group == GroupHsv && !(record.flags & FlagHsv))
+            continue;
+        if (group == GroupRaw && !(record.flags & FlagRaw))
+            continue;
+        if ((group == GroupHsvFrom || group == GroupRawFrom) && !(record.present[group - 1] & fromBit))
+            continue;
+
+        putByte(out, record.present[group]);
+        putByte(out, record.relative[group]);
+        for (int c=0; c < numComponents; ++c) {
+            if (record.hasValue(group, c))
+                putInt32(out, record.values[group][c]);
+        }
+    }
+
+    if (record.flags & FlagName) {
+        putByte(out, record.name.length());
+        for (unsigned i=0; i < record.name.length(); ++i)
+            putByte(out, record.name[i]);
+    }
+}
+
+bool BinaryCommand::encode(const String& methodName, const char* pParams, size_t length, String& out) {
+    const Method method = getMethod(methodName);
+    if (method == Method::Invalid)
+        return false;
+
+    // parse everything first: the message is only built if all of it can be represented
+    Vector<Record> records;
+    if (length > 0) {
+        JsonPullParser parser(pParams, length);
+        if (parser.next() != JsonPullParser::Token::ObjectStart)
+            return false;
+
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::Key && parser.textEquals("cmds") && method == Method::Color) {
+            // batch as relayed by onColor: {"cmds":[...]}
+            if (parser.next() != JsonPullParser::Token::ArrayStart)
+                return false;
+            while ((t = parser.next()) == JsonPullParser::Token::ObjectStart) {
+                if (records.count() >= _maxRecords)
+                    return false;
+                Record record;
+                if (!parseRecord(parser, record))
+                    return false;
+                records.add(record);
+            }
+            if (t != JsonPullParser::Token::ArrayEnd || parser.next() != JsonPullParser::Token::ObjectEnd)
+                return false;
+        }
+        else if (t != JsonPullParser::Token::ObjectEnd) {
+            // single command: start over on the object itself
+            JsonPullParser single(pParams, length);
+            single.next();
+            Record record;
+            if (!parseRecord(single, record))
+                return false;
+            records.add(record);
+        }
+    }
+
+    writeMessage(method, records, out);
+    return true;
+}
+
+bool BinaryCommand::encode(const String& methodName, const JsonObject& params, String& out) {
+    // serialized into a stack buffer for the pull parser path, params that do
+    // not fit are relayed as JSON-RPC
+    char buf[_maxJsonParamsLength];
+    const size_t length = params.size() > 0 ? params.printTo(buf, sizeof(buf)) : 0;
+    if (length >= sizeof(buf) - 1)
+        return false;
+    return encode(methodName, buf, length, out);
+}
+
+void BinaryCommand::writeMessage(Method method, const Vector<Record>& records, String& out) {
+    out = "";
+    out.reserve(8 + records.count() * 24);
+    putByte(out, marker);
+    putByte(out, version);
+    putByte(out, static_cast<uint8_t>(method));
+    putByte(out, records.count());
+    for (int i=0; i < records.count(); ++i)
+        writeRecord(records[i], out);
+}
+
+bool BinaryCommand::Reader::readByte(uint8_t& b) {
+    // undo the byte stuffing while reading
+    if (_pos >= _msg.length())
+        return false;
+    b = _msg[_pos++];
+    if (b == 0x01) {
+        if (_pos >= _msg.length())
+            return false;
+        b = static_cast<uint8_t>(_msg[_pos++]) - 1;
+    }
+    return true;
+}
+
+bool BinaryCommand::Reader::readInt32(int32_t& value) {
+    uint8_t b[4];
+    for (int i=0; i < 4; ++i) {
+        if (!readByte(b[i]))
+            return false;
+    }
+    value = static_cast<int32_t>(b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24));
+    return true;
+}
+
+bool BinaryCommand::readRecord(Reader& reader, Record& record) {
+    uint8_t b;
+    if (!reader.readByte(record.flags) || !reader.readByte(record.queue) || !reader.readByte(record.channels))
+        return false;
+    if (record.flags & FlagDirection) {
+        if (!reader.readByte(b))
+            return false;
+        record.direction = static_cast<int8_t>(b);
+    }
+    if ((record.flags & FlagRamp) && !reader.readInt32(record.ramp))
+        return false;
+
+    for (int group=0; group < GroupCount; ++group) {
+        if (group == GroupHsv && !(record.flags & FlagHsv))
+            continue;
+        if (group == GroupRaw && !(record.flags & FlagRaw))
+            continue;
+        if ((group == GroupHsvFrom || group == GroupRawFrom) && !(record.present[group - 1] & fromBit))
+            continue;
+
+        if (!reader.readByte(record.present[group]) || !reader.readByte(record.relative[group]))
+            return false;
+        for (int c=0; c < numComponents; ++c) {
+            if (record.hasValue(group, c) && !reader.readInt32(record.values[group][c]))
+                return false;
+        }
+    }
+
+    if (record.flags & FlagName) {
+        uint8_t length;
+        if (!reader.readByte(length))
+            return false;
+        record.name.reserve(length);
+        for (int i=0; i < length; ++i) {
+            if (!reader.readByte(b))
+                return false;
+            record.name += static_cast<char>(b);
+        }
+    }
+    return true;
+}
+
+bool BinaryCommand::decode(const String& msg, Method& method, Vector<Record>& records) {
+    Reader reader(msg);
+    uint8_t header[4];
+    for (int i=0; i < 4; ++i) {
+        if (!reader.readByte(header[i]))
+            return false;
+    }
+    if (header[0] != marker || header[1] != version)
+        return false;
+
+    method = static_cast<Method>(header[2]);
+    const int count = header[3];
+    for (int i=0; i < count; ++i) {
+        Record record;
+        if (!readRecord(reader, record))
+            return false;
+        records.add(record);
+    }
+    return reader.isAtEnd();
+}
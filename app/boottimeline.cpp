@@ -0,0 +1,92 @@
+#include <RGBWWCtrl.h>
+
+void BootTimeline::begin() {
+    _hasPrevious = system_rtc_mem_read(_rtcBlock, &_previous, sizeof(_previous)) && _previous.magic == _magic
+            && _previous.numPhases <= PhaseCount;
+
+    memset(&_current, 0, sizeof(_current));
+    _current.magic = _magic;
+    _current.resetReason = system_get_rst_info()->reason;
+    mark(PhaseInit);
+}
+
+void BootTimeline::mark(Phase phase) {
+    Entry& entry = _current.entries[phase];
+    entry.us = system_get_time();
+    entry.heap = system_get_free_heap_size();
+    if (phase >= _current.numPhases)
+        _current.numPhases = phase + 1;
+
+    system_rtc_mem_write(_rtcBlock, &_current, sizeof(_current));
+
+    // marked from the LED timer callback, print from the task queue
+    if (phase == PhaseFirstTick)
+        _printTimer.initializeMs(1, TimerDelegate(&BootTimeline::print, this)).startOnce();
+}
+
+void BootTimeline::fillJson(JsonObject& json) const {
+    fillJson(_current, json);
+    if (_hasPrevious) {
+        JsonObject& previous = json.createNestedObject("previous");
+        fillJson(_previous, previous);
+    }
+}
+
+void BootTimeline::fillJson(const Record& record, JsonObject& json) {
+    json["reset_reason"] = record.resetReason;
+    if (record.numPhases == PhaseCount)
+        json["first_light_us"] = record.entries[PhaseFirstTick].us;
+
+    JsonObject& phases = json.createNestedObject("phases");
+    for (int i=0; i < record.numPhases; ++i) {
+        JsonArray& phase = phases.createNestedArray(getPhaseName(i));
+        phase.add(record.entries[i].us);
+        phase.add(record.entries[i].heap);
+    }
+}
+
+void BootTimeline::print() {
+    Serial.printf("BootTimeline: reset reason %d\n", _current.resetReason);
+    Serial.printf("  %-14s %10s %8s %8s\n", "phase", "us", "delta_us", "heap");
+    for (int i=0; i < _current.numPhases; ++i) {
+        const Entry& entry = _current.entries[i];
+        const uint32_t delta = (i > 0) ? entry.us - _current.entries[i - 1].us : 0;
+        Serial.printf("  %-14s %10u %8u %8u\n", getPhaseName(i), entry.us, delta, entry.heap);
+    }
+
+    if (_hasPrevious && _previous.numPhases < PhaseCount)
+        Serial.printf("  previous boot stopped after phase %s\n", _previous.numPhases > 0 ? getPhaseName(_previous.numPhases - 1) : "-");
+}
+
+const char* BootTimeline::getPhaseName(int phase) {
+    switch (phase) {
+    case PhaseInit:
+        return "init";
+    case PhaseMountFs:
+        return "mount_fs";
+    case PhaseOtaCheck:
+        return "ota_check";
+    case PhaseConfig:
+        return "config";
+    case PhaseMqtt:
+        return "mqtt";
+    case PhaseLedCtrl:
+        return "ledctrl";
+    case PhaseButtons:
+        return "buttons";
+    case PhaseNetwork:
+        return "network";
+    case PhaseWebServer:
+        return "webserver";
+    case PhaseSystemReady:
+        return "system_ready";
+    case PhaseLedStart:
+        return "led_start";
+    case PhaseServices:
+        return "services";
+    case PhaseFirstTick:
+        return "first_tick";
+    default:
+        return "";
+    }
+}
@@ -0,0 +1,70 @@
+#include <RGBWWCtrl.h>
+
+void ColorJson::toFixed(const HSVCT& color, uint32_t& h, uint32_t& s, uint32_t& v) {
+    // same scaling as HSVCT::asRadian, rounded to two decimals
+    h = (static_cast<uint32_t>(color.h) * 36000 + RGBWW_CALC_HUEWHEELMAX / 2) / RGBWW_CALC_HUEWHEELMAX;
+    s = (static_cast<uint32_t>(color.s) * 10000 + RGBWW_CALC_MAXVAL / 2) / RGBWW_CALC_MAXVAL;
+    v = (static_cast<uint32_t>(color.v) * 10000 + RGBWW_CALC_MAXVAL / 2) / RGBWW_CALC_MAXVAL;
+}
+
+char* ColorJson::writeString(char* p, const char* str) {
+    while (*str)
+        *p++ = *str++;
+    return p;
+}
+
+char* ColorJson::writeUInt(char* p, uint32_t value) {
+    char tmp[10];
+    int len = 0;
+    do {
+        tmp[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (len > 0)
+        *p++ = tmp[--len];
+    return p;
+}
+
+char* ColorJson::writeFixed(char* p, uint32_t value) {
+    p = writeUInt(p, value / 100);
+    const uint32_t fraction = value % 100;
+    if (fraction != 0) {
+        *p++ = '.';
+        *p++ = '0' + fraction / 10;
+        if (fraction % 10 != 0)
+            *p++ = '0' + fraction % 10;
+    }
+    return p;
+}
+
+char* ColorJson::writeHsv(char* p, const HSVCT& color) {
+    uint32_t h, s, v;
+    toFixed(color, h, s, v);
+
+    p = writeString(p, "{\"h\":");
+    p = writeFixed(p, h);
+    p = writeString(p, ",\"s\":");
+    p = writeFixed(p, s);
+    p = writeString(p, ",\"v\":");
+    p = writeFixed(p, v);
+    p = writeString(p, ",\"ct\":");
+    p = writeUInt(p, color.ct > 0 ? color.ct : 0);
+    *p++ = '}';
+    return p;
+}
+
+char* ColorJson::writeRaw(char* p, const ChannelOutput& raw) {
+    p = writeString(p, "{\"r\":");
+    p = writeUInt(p, raw.r);
+    p = writeString(p, ",\"g\":");
+    p = writeUInt(p, raw.g);
+    p = writeString(p, ",\"b\":");
+    p = writeUInt(p, raw.b);
+    p = writeString(p, ",\"ww\":");
+    p = writeUInt(p, raw.ww);
+    p = writeString(p, ",\"cw\":");
+    p = writeUInt(p, raw.cw);
+    *p++ = '}';
+    return p;
+}
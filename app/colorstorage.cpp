@@ -0,0 +1,186 @@
+#include <RGBWWCtrl.h>
+
+const uint16_t ColorStorage::Record::marker;
+
+bool ColorStorage::load(HSVCT& color) {
+    scan();
+    if (_hasPersisted) {
+        color = _persisted;
+        return true;
+    }
+    return loadLegacy(color);
+}
+
+void ColorStorage::save(const HSVCT& color) {
+    _pending = color;
+    _hasPending = true;
+    if (!_writeTimer.isStarted())
+        _writeTimer.initializeMs(_writeDelayMs, TimerDelegate(&ColorStorage::flush, this)).startOnce();
+}
+
+void ColorStorage::flush() {
+    _writeTimer.stop();
+    if (!_hasPending)
+        return;
+
+    _hasPending = false;
+    write(_pending);
+}
+
+void ColorStorage::scan() {
+    if (_scanned)
+        return;
+    _scanned = true;
+
+    int newest = -1;
+    Record newestRecord;
+    for (int i=0; i < _numRecords; ++i) {
+        Record record;
+        if (!readRecord(i, record) || !isValid(record))
+            continue;
+        if (newest < 0 || static_cast<int32_t>(record.seq - newestRecord.seq) > 0) {
+            newest = i;
+            newestRecord = record;
+        }
+    }
+
+    if (newest < 0) {
+        debug_i("ColorStorage: log empty");
+        return;
+    }
+
+    _hasPersisted = true;
+    _persisted.h = newestRecord.h;
+    _persisted.s = newestRecord.s;
+    _persisted.v = newestRecord.v;
+    _persisted.ct = newestRecord.ct;
+    _nextSeq = newestRecord.seq + 1;
+    _nextIndex = (newest + 1) % _numRecords;
+    debug_i("ColorStorage: record %d | seq %u", newest, newestRecord.seq);
+    scheduleErase();
+}
+
+bool ColorStorage::loadLegacy(HSVCT& color) {
+    if (!fileExist(APP_COLOR_FILE))
+        return false;
+
+    String json = fileGetContent(APP_COLOR_FILE);
+    StaticJsonBuffer<72> jsonBuffer;
+    JsonObject& root = jsonBuffer.parseObject(json);
+    if (!root.success())
+        return false;
+
+    color.h = root["h"];
+    color.s = root["s"];
+    color.v = root["v"];
+    color.ct = root["ct"];
+
+    debug_i("ColorStorage: migrating %s", APP_COLOR_FILE);
+    write(color);
+    fileDelete(APP_COLOR_FILE);
+    return true;
+}
+
+void ColorStorage::write(const HSVCT& color) {
+    scan();
+    if (_hasPersisted && _persisted == color)
+        return;
+
+    Record record;
+    record.recordMarker = Record::marker;
+    record.seq = _nextSeq;
+    record.h = color.h;
+    record.s = color.s;
+    record.v = color.v;
+    record.ct = color.ct;
+    record.crc = getCrc(record);
+
+    // slots left dirty by an interrupted write are skipped, the next sector is erased on entry
+    int index = _nextIndex;
+    Record slot;
+    while (index % _recordsPerSector != 0 && !(readRecord(index, slot) && isErased(slot)))
+        index = (index + 1) % _numRecords;
+
+    if (index % _recordsPerSector == 0) {
+        const int sector = index / _recordsPerSector;
+        if (sector != _erasedSector)
+            eraseSector(sector);
+        _erasedSector = -1;
+    }
+
+    if (spi_flash_write(getAddress(index), reinterpret_cast<uint32_t*>(&record), sizeof(record)) != SPI_FLASH_RESULT_OK) {
+        debug_e("ColorStorage::write: writing record %d failed", index);
+        return;
+    }
+
+    _hasPersisted = true;
+    _persisted = color;
+    ++_nextSeq;
+    _nextIndex = (index + 1) % _numRecords;
+    scheduleErase();
+}
+
+int ColorStorage::getNextSector() const {
+    // the sector of the next sector start at or after _nextIndex
+    return ((_nextIndex + _recordsPerSector - 1) / _recordsPerSector) % COLOR_LOG_SECTORS;
+}
+
+bool ColorStorage::isSectorErased(int sector) const {
+    Record record;
+    for (int i=sector * _recordsPerSector; i < (sector + 1) * _recordsPerSector; ++i) {
+        if (!readRecord(i, record) || !isErased(record))
+            return false;
+    }
+    return true;
+}
+
+void ColorStorage::eraseSector(int sector) {
+    const uint32_t startUs = system_get_time();
+    spi_flash_erase_sector(getAddress(sector * _recordsPerSector) / _sectorSize);
+    app.rgbwwctrl.getTickStats().onStall(system_get_time() - startUs);
+}
+
+void ColorStorage::scheduleErase() {
+    if (getNextSector() == _erasedSector || _eraseTimer.isStarted())
+        return;
+    _eraseTimer.initializeMs(_eraseCheckMs, TimerDelegate(&ColorStorage::eraseAhead, this)).start();
+}
+
+void ColorStorage::eraseAhead() {
+    // the erase blocks the LED tick, which only goes unnoticed while the output is static
+    if (!app.rgbwwctrl.isIdle())
+        return;
+
+    _eraseTimer.stop();
+    const int sector = getNextSector();
+    if (!isSectorErased(sector))
+        eraseSector(sector);
+    _erasedSector = sector;
+}
+
+bool ColorStorage::readRecord(int index, Record& record) const {
+    return spi_flash_read(getAddress(index), reinterpret_cast<uint32_t*>(&record), sizeof(record)) == SPI_FLASH_RESULT_OK;
+}
+
+bool ColorStorage::isValid(const Record& record) {
+    return record.recordMarker == Record::marker && record.crc == getCrc(record);
+}
+
+bool ColorStorage::isErased(const Record& record) {
+    const uint32_t* pWords = reinterpret_cast<const uint32_t*>(&record);
+    for (unsigned i=0; i < sizeof(record) / sizeof(uint32_t); ++i) {
+        if (pWords[i] != 0xFFFFFFFF)
+            return false;
+    }
+    return true;
+}
+
+uint16_t ColorStorage::getCrc(const Record& record) {
+    // everything behind the crc field
+    const uint8_t* pStart = reinterpret_cast<const uint8_t*>(&record.seq);
+    return crc16(pStart, reinterpret_cast<const uint8_t*>(&record + 1) - pStart);
+}
+
+uint32_t ColorStorage::getAddress(int index) {
+    return COLOR_LOG_ADDR + index * sizeof(Record);
+}
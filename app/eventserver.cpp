@@ -5,20 +5,33 @@
  *      Author: Robin
  */
 #include <RGBWWCtrl.h>
+#include <algorithm>
 
+const uint8_t BinaryColorFrame::marker;
+const uint8_t BinaryColorFrame::version;
+const uint8_t BinaryColorFrame::flagHsv;
 
 EventServer::~EventServer() {
     stop();
+    for (int i=0; i < _numColorMessages; ++i) {
+        if (_colorMessages[i])
+            _colorMessages[i]->release();
+    }
 }
 
 void EventServer::start() {
     debug_i("Starting event server\n");
+    for (int i=0; i < _numColorMessages; ++i) {
+        if (!_colorMessages[i])
+            _colorMessages[i] = SharedMessage::createBuffer(_colorMessageSize, SharedMessage::Kind::Color);
+    }
+
     setTimeOut(_connectionTimeout);
     if (not listen(_tcpPort)) {
         debug_e("EventServer failed to open listening port!");
     }
 
-    TimerDelegateStdFunction fnc = std::bind(&EventServer::publishKeepAlive, this);
+    TimerDelegateStdFunction fnc = std::bind(&EventServer::onKeepAliveTimer, this);
     _keepAliveTimer.initializeMs(_keepAliveInterval * 1000, fnc).start();
 }
 
@@ -32,45 +45,229 @@ void EventServer::stop() {
 void EventServer::onClient(TcpClient *client) {
     TcpServer::onClient(client);
     debug_d("Client connected from: %s\n", client->getRemoteIp().toString().c_str());
+
+    ClientInfo info;
+    info.pClient = client;
+    _clients.add(info);
 }
 
 void EventServer::onClientComplete(TcpClient& client, bool succesfull) {
+    const int idx = findClient(&client);
+    if (idx >= 0) {
+        if (_clients[idx].format == ClientFormat::Binary)
+            --_numBinaryClients;
+        debug_d("Client %x: coalesced %d messages\n", &client, _clients[idx].numCoalesced);
+        releasePending(_clients[idx]);
+        _clients.remove(idx);
+    }
+
     TcpServer::onClientComplete(client, succesfull);
     debug_d("Client removed: %x\n", &client);
 }
 
+bool EventServer::onClientReceive(TcpClient& client, char *data, int size) {
+    const int idx = findClient(&client);
+    if (idx < 0)
+        return true;
+
+    // requests are tiny and expected to arrive in a single segment
+    if (size <= 0 || size > _maxRequestSize) {
+        debug_w("EventServer::onClientReceive: ignoring request of size %d\n", size);
+        return true;
+    }
+
+    onClientRequest(_clients[idx], String(data, size));
+    return true;
+}
+
+void EventServer::onClientRequest(ClientInfo& info, const String& request) {
+    JsonRpcMessageIn rpc(request);
+    if (!rpc.getRoot().success()) {
+        debug_w("EventServer::onClientRequest: cannot parse request\n");
+        return;
+    }
+
+    const String method = rpc.getMethod();
+    if (method == "set_format") {
+        onSetFormat(info, rpc);
+    } else if (method == "get_tick_stats") {
+        onGetTickStats(info, rpc);
+    } else {
+        debug_w("EventServer::onClientRequest: unknown method: %s\n", method.c_str());
+    }
+}
+
+void EventServer::onSetFormat(ClientInfo& info, JsonRpcMessageIn& rpc) {
+    const String format = rpc.getParams()["format"].asString();
+    ClientFormat newFormat;
+    if (format == "binary") {
+        newFormat = ClientFormat::Binary;
+    } else if (format == "json") {
+        newFormat = ClientFormat::Json;
+    } else {
+        debug_w("EventServer::onClientRequest: unknown format: %s\n", format.c_str());
+        return;
+    }
+
+    if (newFormat != info.format) {
+        _numBinaryClients += (newFormat == ClientFormat::Binary) ? 1 : -1;
+        info.format = newFormat;
+    }
+
+    debug_d("EventServer: client %x uses format: %s\n", info.pClient, format.c_str());
+
+    // confirm so the client knows how to decode the following color frames
+    DynamicJsonBuffer jsonBuffer(200);
+    JsonObject& root = jsonBuffer.createObject();
+    root["jsonrpc"] = "2.0";
+    if (rpc.getRoot()["id"].success())
+        root["id"] = rpc.getRoot()["id"];
+    JsonObject& result = root.createNestedObject("result");
+    result["format"] = format;
+    if (newFormat == ClientFormat::Binary) {
+        result["frame_marker"] = BinaryColorFrame::marker;
+        result["frame_version"] = BinaryColorFrame::version;
+        result["frame_size"] = sizeof(BinaryColorFrame);
+        result["hue_max"] = RGBWW_CALC_HUEWHEELMAX;
+        result["val_max"] = RGBWW_CALC_MAXVAL;
+    }
+
+    sendResponse(info, root);
+}
+
+void EventServer::onGetTickStats(ClientInfo& info, JsonRpcMessageIn& rpc) {
+    // computed on request only, the percentiles sort the ring of samples
+    DynamicJsonBuffer jsonBuffer(512);
+    JsonObject& root = jsonBuffer.createObject();
+    root["jsonrpc"] = "2.0";
+    if (rpc.getRoot()["id"].success())
+        root["id"] = rpc.getRoot()["id"];
+    JsonObject& result = root.createNestedObject("result");
+    result["interval_us"] = app.rgbwwctrl.getTimerInterval();
+    app.rgbwwctrl.getTickStats().fillJson(result);
+
+    sendResponse(info, root);
+}
+
+void EventServer::sendResponse(ClientInfo& info, const JsonObject& root) {
+    // goes through the same queue as events so it cannot overtake or split pending messages
+    SharedMessage* pMsg = SharedMessage::create(root, SharedMessage::Kind::Ordered);
+    enqueue(info, pMsg);
+    pMsg->release();
+    if (info.overflow)
+        closeOverflowed();
+    else
+        drain(info);
+}
+
+int EventServer::findClient(TcpClient* pClient) const {
+    for (int i=0; i < _clients.count(); ++i) {
+        if (_clients[i].pClient == pClient)
+            return i;
+    }
+    return -1;
+}
+
+void EventServer::registerTickTasks(TickScheduler& scheduler) {
+    scheduler.addTask(&app.cfg.events.color_interval_ms, TickScheduler::TaskDelegate(&EventServer::onColorTask, this), TickProfiler::PhaseEvents, true);
+}
+
+void EventServer::onColorTask() {
+    if (!app.cfg.events.server_enabled)
+        return;
+
+    const uint32_t now = millis();
+    if (now - _lastColorEvent < app.cfg.events.color_mininterval_ms)
+        return;
+    _lastColorEvent = now;
+
+    const HSVCT* pHsv = NULL;
+    if (app.rgbwwctrl.getMode() == RGBWWLed::ColorMode::Hsv)
+        pHsv = &app.rgbwwctrl.getCurrentColor();
+
+    publishCurrentState(app.rgbwwctrl.getCurrentOutput(), pHsv);
+}
+
 void EventServer::publishCurrentState(const ChannelOutput& raw, const HSVCT* pHsv) {
     if (raw == _lastRaw)
         return;
     _lastRaw = raw;
 
-    JsonRpcMessage msg("color_event");
-    JsonObject& root = msg.getParams();
+    if (_numBinaryClients > 0)
+        sendColorFrame(raw, pHsv);
 
-    root["mode"] = pHsv ? "hsv" : "raw";
+    // skip building the JSON message if nobody wants it
+    if (_clients.count() <= _numBinaryClients && app.webserver.getNumEventClients() == 0)
+        return;
 
-    JsonObject& rawJson = root.createNestedObject("raw");
-    rawJson["r"] = raw.r;
-    rawJson["g"] = raw.g;
-    rawJson["b"] = raw.b;
-    rawJson["ww"] = raw.ww;
-    rawJson["cw"] = raw.cw;
+    debug_d("EventServer::publishCurrentHsv\n");
 
+    // color events are formatted directly (fixed point), same layout as a JsonRpcMessage
+    SharedMessage* pMsg = getColorMessage();
+    char* const pStart = pMsg->getBuffer();
+    char* p = ColorJson::writeString(pStart, "{\"jsonrpc\":\"2.0\",\"method\":\"color_event\",\"params\":{\"mode\":");
+    p = ColorJson::writeString(p, pHsv ? "\"hsv\"" : "\"raw\"");
+    p = ColorJson::writeString(p, ",\"raw\":");
+    p = ColorJson::writeRaw(p, raw);
     if (pHsv) {
-        float h, s, v;
-        int ct;
-        pHsv->asRadian(h, s, v, ct);
+        p = ColorJson::writeString(p, ",\"hsv\":");
+        p = ColorJson::writeHsv(p, *pHsv);
+    }
+    p = ColorJson::writeString(p, "},\"id\":");
+    p = ColorJson::writeUInt(p, _nextId++);
+    *p++ = '}';
+    pMsg->setLength(p - pStart);
+
+    broadcast(pMsg, true, false);
+    pMsg->release();
+}
+
+void EventServer::sendColorFrame(const ChannelOutput& raw, const HSVCT* pHsv) {
+    // encode once into a preallocated message, every binary client streams from it
+    SharedMessage* pMsg = getColorMessage();
+    BinaryColorFrame& frame = *reinterpret_cast<BinaryColorFrame*>(pMsg->getBuffer());
+    frame.frameMarker = BinaryColorFrame::marker;
+    frame.frameVersion = BinaryColorFrame::version;
+    frame.flags = pHsv ? BinaryColorFrame::flagHsv : 0;
+    frame.reserved = 0;
+    frame.seq = _colorSeq++;
+    frame.timestampMs = millis();
 
-        JsonObject& hsvJson = root.createNestedObject("hsv");
-        hsvJson["h"] = h;
-        hsvJson["s"] = s;
-        hsvJson["v"] = v;
-        hsvJson["ct"] = ct;
+    frame.raw[0] = raw.r;
+    frame.raw[1] = raw.g;
+    frame.raw[2] = raw.b;
+    frame.raw[3] = raw.ww;
+    frame.raw[4] = raw.cw;
+
+    if (pHsv) {
+        frame.hsv[0] = pHsv->h;
+        frame.hsv[1] = pHsv->s;
+        frame.hsv[2] = pHsv->v;
+        frame.hsv[3] = pHsv->ct;
+    } else {
+        frame.hsv[0] = frame.hsv[1] = frame.hsv[2] = frame.hsv[3] = 0;
     }
 
-    debug_d("EventServer::publishCurrentHsv\n");
+    pMsg->setLength(sizeof(frame));
 
-    sendToClients(msg);
+    broadcast(pMsg, false, true);
+    pMsg->release();
+}
+
+SharedMessage* EventServer::getColorMessage() {
+    static_assert(sizeof(BinaryColorFrame) <= _colorMessageSize, "color frame exceeds the color messages");
+
+    for (int i=0; i < _numColorMessages; ++i) {
+        SharedMessage* pMsg = _colorMessages[i];
+        if (pMsg && !pMsg->isShared()) {
+            pMsg->addRef();
+            return pMsg;
+        }
+    }
+
+    // slow clients still hold all of them, this one is freed by the last release()
+    ++_numColorFallbacks;
+    return SharedMessage::createBuffer(_colorMessageSize, SharedMessage::Kind::Color);
 }
 
 void EventServer::publishClockSlaveStatus(uint32_t offset, uint32_t interval) {
@@ -80,7 +277,7 @@ void EventServer::publishClockSlaveStatus(uint32_t offset, uint32_t interval) {
     JsonObject& root = msg.getParams();
     root["offset"] = offset;
     root["current_interval"] = interval;
-    sendToClients(msg);
+    sendToClients(msg, SharedMessage::Kind::ClockStatus);
 }
 
 void EventServer::publishKeepAlive() {
@@ -90,6 +287,10 @@ void EventServer::publishKeepAlive() {
     sendToClients(msg);
 }
 
+void EventServer::onKeepAliveTimer() {
+    publishKeepAlive();
+}
+
 void EventServer::publishTransitionFinished(const String& name, bool requeued) {
     debug_d("EventServer::publishTransitionComplete: %s\n", name.c_str());
 
@@ -101,15 +302,194 @@ void EventServer::publishTransitionFinished(const String& name, bool requeued) {
     sendToClients(msg);
 }
 
-void EventServer::sendToClients(JsonRpcMessage& rpcMsg) {
+void EventServer::sendToClients(JsonRpcMessage& rpcMsg, SharedMessage::Kind kind) {
     //Serial.printf("EventServer: sendToClient: %x, Vector: %x Tests: %d\n", _client, _clients.elementAt(0), _tests[0]);
+    if (_clients.count() == 0 && app.webserver.getNumEventClients() == 0)
+        return;
+
     rpcMsg.setId(_nextId++);
 
-    String jsonStr;
-    rpcMsg.getRoot().printTo(jsonStr);
+    // serialize once for all clients. Binary clients get color events as frames instead
+    SharedMessage* pMsg = SharedMessage::create(rpcMsg.getRoot(), kind);
+    broadcast(pMsg, true, kind != SharedMessage::Kind::Color);
+    pMsg->release();
+}
+
+void EventServer::broadcast(SharedMessage* pMsg, bool jsonClients, bool binaryClients) {
+    bool overflow = false;
+    for(int i=0; i < _clients.count(); ++i) {
+        ClientInfo& info = _clients[i];
+        // a closing client only waits for its disconnect callback
+        if (info.overflow)
+            continue;
+
+        const bool isBinary = info.format == ClientFormat::Binary;
+        if ((isBinary && !binaryClients) || (!isBinary && !jsonClients))
+            continue;
+
+        // whatever does not fit into the send buffer is written from onClientReady()
+        enqueue(info, pMsg);
+        if (info.overflow)
+            overflow = true;
+        else
+            drain(info);
+    }
+
+    if (overflow)
+        closeOverflowed();
+
+    // the webapp's event stream gets the same serialized JSON
+    if (jsonClients)
+        app.webserver.sendEvent(pMsg);
+}
+
+int EventServer::getLatestSlot(SharedMessage::Kind kind) {
+    switch (kind) {
+    case SharedMessage::Kind::Color:
+        return 0;
+    case SharedMessage::Kind::ClockStatus:
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+void EventServer::enqueue(ClientInfo& info, SharedMessage* pMsg) {
+    if (info.overflow)
+        return;
+
+    const int slot = getLatestSlot(pMsg->getKind());
+    if (slot >= 0) {
+        // latest state wins: a newer message replaces the one still waiting in the slot
+        if (info.latest[slot]) {
+            info.latest[slot]->release();
+            ++info.numCoalesced;
+            ++_numCoalesced;
+        }
+        pMsg->addRef();
+        info.latest[slot] = pMsg;
+        return;
+    }
+
+    if (info.orderedCount == _maxOrderedMessages) {
+        // ordered messages must not be lost, so a client which cannot keep up gets disconnected
+        debug_w("EventServer: client %x too slow - disconnecting\n", info.pClient);
+        info.overflow = true;
+        ++_numOverflows;
+        releasePending(info);
+        return;
+    }
+
+    pMsg->addRef();
+    info.ordered[(info.orderedHead + info.orderedCount) % _maxOrderedMessages] = pMsg;
+    ++info.orderedCount;
+}
+
+SharedMessage* EventServer::popNextMessage(ClientInfo& info) {
+    if (info.orderedCount > 0) {
+        SharedMessage* pMsg = info.ordered[info.orderedHead];
+        info.ordered[info.orderedHead] = nullptr;
+        info.orderedHead = (info.orderedHead + 1) % _maxOrderedMessages;
+        --info.orderedCount;
+        return pMsg;
+    }
+
+    for (int i=0; i < _numLatestSlots; ++i) {
+        if (info.latest[i]) {
+            SharedMessage* pMsg = info.latest[i];
+            info.latest[i] = nullptr;
+            return pMsg;
+        }
+    }
+    return nullptr;
+}
 
-    for(int i=0; i < connections.size(); ++i) {
-        TcpClient* pClient = (TcpClient*)connections[i];
-        pClient->sendString(jsonStr);
+void EventServer::releasePending(ClientInfo& info) {
+    if (info.pCurrent) {
+        info.pCurrent->release();
+        info.pCurrent = nullptr;
     }
+
+    SharedMessage* pMsg;
+    while ((pMsg = popNextMessage(info)) != nullptr)
+        pMsg->release();
+}
+
+bool EventServer::drain(ClientInfo& info) {
+    bool written = false;
+    while (true) {
+        const int available = info.pClient->getAvailableWriteSize();
+        if (available <= 0)
+            break;
+
+        // only take the next message out of its slot when it can be written right away
+        if (!info.pCurrent) {
+            info.pCurrent = popNextMessage(info);
+            info.currentOffset = 0;
+            if (!info.pCurrent)
+                break;
+        }
+
+        const int remaining = info.pCurrent->getLength() - info.currentOffset;
+        const int len = std::min(remaining, available);
+
+        // lwIP copies the data into its own send buffer, so the shared message can be released afterwards
+        if (info.pClient->write(info.pCurrent->getData() + info.currentOffset, len) < 0)
+            break;
+
+        written = true;
+        info.currentOffset += len;
+        if (info.currentOffset < info.pCurrent->getLength())
+            break;
+
+        info.pCurrent->release();
+        info.pCurrent = nullptr;
+    }
+
+    if (written)
+        info.pClient->flush();
+
+    return !info.pCurrent && info.orderedCount == 0 && !hasLatest(info);
+}
+
+bool EventServer::hasLatest(const ClientInfo& info) {
+    for (int i=0; i < _numLatestSlots; ++i) {
+        if (info.latest[i])
+            return true;
+    }
+    return false;
+}
+
+TcpConnection* EventServer::createClient(tcp_pcb* clientTcp) {
+    return new EventClient(clientTcp, *this);
+}
+
+void EventServer::onClientReady(TcpClient& client) {
+    // the client acknowledged data, so there is room in its send buffer again
+    const int idx = findClient(&client);
+    if (idx >= 0 && !_clients[idx].overflow)
+        drain(_clients[idx]);
+}
+
+void EventServer::closeOverflowed() {
+    // iterate backwards: closing a client may remove it from the list
+    for(int i=_clients.count() - 1; i >= 0; --i) {
+        ClientInfo& info = _clients[i];
+        if (info.overflow && !info.closeRequested) {
+            info.closeRequested = true;
+            info.pClient->close();
+        }
+    }
+}
+
+EventServer::EventClient::EventClient(tcp_pcb* clientTcp, EventServer& server) :
+        TcpClient(clientTcp, TcpClientDataDelegate(&EventServer::onClientReceive, &server),
+                TcpClientCompleteDelegate(&EventServer::onClientComplete, &server)),
+        _server(server) {
+}
+
+void EventServer::EventClient::onReadyToSendData(TcpConnectionEvent sourceEvent) {
+    TcpClient::onReadyToSendData(sourceEvent);
+    if (sourceEvent == eTCE_Sent || sourceEvent == eTCE_Poll)
+        _server.onClientReady(*this);
 }
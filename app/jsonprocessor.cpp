@@ -2,32 +2,311 @@
 
 
 bool JsonProcessor::onColor(const String& json, String& msg, bool relay) {
-    debug_e("JsonProcessor::onColor: %s", json.c_str());
-    DynamicJsonBuffer jsonBuffer;
-    JsonObject& root = jsonBuffer.parseObject(json);
-    return onColor(root, msg, relay);
+    debug_d("JsonProcessor::onColor: %s", json.c_str());
+    return onColor(json.c_str(), json.length(), msg, relay);
+}
+
+bool JsonProcessor::onColor(const char* pJson, size_t length, String& msg, bool relay, Vector<String>* pCmdErrors) {
+    RequestParameters params;
+    Vector<RequestParameters> cmds;
+    String relayCmds;
+    bool hasCmds = false;
+    if (!parseColor(pJson, length, params, cmds, hasCmds, relay ? &relayCmds : nullptr, msg))
+        return false;
+
+    // with a lead time the master relays the command with a start step and
+    // executes it itself on that step, like the slaves
+    uint32_t atStep = 0;
+    const bool scheduled = relay && app.getCommandStartStep(atStep);
+
+    if (!hasCmds) {
+        if (scheduled) {
+            if (!isValidColorCommand(params, msg))
+                return false;
+            app.onCommandRelay("color", pJson, length, atStep);
+            cmds.add(params);
+            return app.rgbwwctrl.scheduleColorCommands(atStep, cmds) || onSingleColorCommand(params, msg);
+        }
+
+        const bool result = onSingleColorCommand(params, msg);
+        if (relay)
+            app.onCommandRelay("color", pJson, length);
+        return result;
+    }
+
+    Vector<String> errors;
+    Vector<String>& cmdErrors = pCmdErrors ? *pCmdErrors : errors;
+    const bool executed = scheduled ? validateColorBatch(cmds, cmdErrors) : onColorBatch(cmds, cmdErrors);
+
+    String joined;
+    for (int i=0; i < cmdErrors.count(); ++i) {
+        if (cmdErrors[i].length() > 0)
+            joined += cmdErrors[i] + "|";
+    }
+
+    if (!executed) {
+        // a rejected batch was not executed locally, so it is not relayed either
+        debug_w("JsonProcessor::onColor: batch rejected: %s", joined.c_str());
+        msg = "Batch rejected";
+        return false;
+    }
+
+    if (relay) {
+        String relayMsg;
+        relayMsg.reserve(relayCmds.length() + 11);
+        relayMsg += "{\"cmds\":[";
+        relayMsg += relayCmds;
+        relayMsg += "]}";
+        if (scheduled) {
+            app.onCommandRelay("color", relayMsg.c_str(), relayMsg.length(), atStep);
+            // not schedulable (late step, full schedule): execute now, and
+            // report it if that fails
+            if (!app.rgbwwctrl.scheduleColorCommands(atStep, cmds) && !onColorBatch(cmds, cmdErrors)) {
+                msg = "Batch rejected";
+                return false;
+            }
+        }
+        else {
+            app.onCommandRelay("color", relayMsg.c_str(), relayMsg.length());
+        }
+    }
+
+    if (joined.length() > 0) {
+        msg = joined;
+        return false;
+    }
+
+    return true;
+}
+
+bool JsonProcessor::parseColor(const char* pJson, size_t length, RequestParameters& params, Vector<RequestParameters>& cmds, bool& hasCmds, String* pRelayCmds, String& msg) {
+    JsonPullParser parser(pJson, length);
+    if (parser.next() != JsonPullParser::Token::ObjectStart) {
+        msg = "Invalid json";
+        return false;
+    }
+
+    // single command parameters are collected while walking the root object,
+    // commands in "cmds" are collected for a batch
+    for (;;) {
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            break;
+        if (t != JsonPullParser::Token::Key) {
+            msg = "Invalid json";
+            return false;
+        }
+
+        if (!parser.textEquals("cmds")) {
+            if (!parseRequestParam(parser, params)) {
+                msg = "Invalid json";
+                return false;
+            }
+            continue;
+        }
+
+        hasCmds = true;
+        if (parser.next() != JsonPullParser::Token::ArrayStart) {
+            msg = "Invalid json";
+            return false;
+        }
+
+        for (;;) {
+            const size_t cmdStart = parser.getValueStart();
+            t = parser.next();
+            if (t != JsonPullParser::Token::ObjectStart)
+                break;
+
+            if (cmds.count() >= _maxBatchCommands) {
+                msg = "Too many commands";
+                return false;
+            }
+
+            RequestParameters cmdParams;
+            if (!parseRequestParams(parser, cmdParams)) {
+                msg = "Invalid json";
+                return false;
+            }
+            cmds.add(cmdParams);
+
+            if (pRelayCmds) {
+                if (pRelayCmds->length() > 0)
+                    *pRelayCmds += ",";
+                appendCompact(*pRelayCmds, pJson + cmdStart, parser.getPosition() - cmdStart);
+            }
+        }
+        if (t != JsonPullParser::Token::ArrayEnd) {
+            msg = "Invalid json";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonProcessor::scheduleColor(uint32_t step, const char* pJson, size_t length, String& msg) {
+    // parsed right away, the LED timer only queues the commands when the step is due
+    RequestParameters params;
+    Vector<RequestParameters> cmds;
+    bool hasCmds = false;
+    if (!parseColor(pJson, length, params, cmds, hasCmds, nullptr, msg))
+        return false;
+
+    if (!hasCmds)
+        cmds.add(params);
+
+    Vector<String> errors;
+    if (!validateColorBatch(cmds, errors)) {
+        msg = "Batch rejected";
+        return false;
+    }
+
+    return app.rgbwwctrl.scheduleColorCommands(step, cmds) || onScheduledColor(cmds, msg);
+}
+
+bool JsonProcessor::onScheduledColor(Vector<RequestParameters>& cmds, String& msg) {
+    if (cmds.count() == 1)
+        return onSingleColorCommand(cmds[0], msg);
+
+    Vector<String> errors;
+    if (!onColorBatch(cmds, errors)) {
+        msg = "Batch rejected";
+        return false;
+    }
+    return true;
+}
+
+bool JsonProcessor::onColorBatch(Vector<RequestParameters>& cmds, Vector<String>& errors) {
+    // validate every command before the first one is queued, so a bad command
+    // in the middle of a scene does not leave the fixture with half a scene.
+    // Returns false if the batch was rejected or could not be queued completely
+    if (!validateColorBatch(cmds, errors))
+        return false;
+
+    for (int i=0; i < cmds.count(); ++i) {
+        if (onSingleColorCommand(cmds[i], errors[i]))
+            continue;
+
+        // validateColorBatch() checked that the batch fits into the queues, so
+        // they were filled by animations queued before the batch. RGBWWLed has
+        // no way to take back single entries, the queues are cleared instead of
+        // keeping the first part of the scene queued
+        debug_w("JsonProcessor::onColorBatch: command %d of %d not queued, clearing queues", i + 1, cmds.count());
+        RGBWWLed::ChannelList allChannels;
+        app.rgbwwctrl.clearAnimationQueue(allChannels);
+        for (int j=i+1; j < cmds.count(); ++j)
+            errors[j] = "Not executed";
+        return false;
+    }
+    return true;
+}
+
+bool JsonProcessor::validateColorBatch(const Vector<RequestParameters>& cmds, Vector<String>& errors) {
+    errors.clear();
+    bool valid = true;
+    for (int i=0; i < cmds.count(); ++i) {
+        String error;
+        if (!isValidColorCommand(cmds[i], error))
+            valid = false;
+        errors.add(error);
+    }
+
+    if (valid)
+        valid = checkQueueDepth(cmds, errors);
+
+    if (!valid) {
+        for (int i=0; i < errors.count(); ++i) {
+            if (errors[i].length() == 0)
+                errors[i] = "Not executed";
+        }
+    }
+    return valid;
+}
+
+bool JsonProcessor::isValidColorCommand(const RequestParameters& params, String& errorMsg) {
+    if (params.checkParams(errorMsg) != 0)
+        return false;
+
+    if (params.mode == RequestParameters::Mode::Undefined) {
+        errorMsg = "No color object!";
+        return false;
+    }
+    return true;
+}
+
+bool JsonProcessor::checkQueueDepth(const Vector<RequestParameters>& cmds, Vector<String>& errors) {
+    // RGBWWLed keeps RGBWW_ANIMATIONQSIZE animations per channel, HSV and RAW
+    // commands use separate channels. Each command is counted as if it used all
+    // channels of its mode, "single" and "front_reset" clear the queue first
+    int hsvDepth = 0;
+    int rawDepth = 0;
+    for (int i=0; i < cmds.count(); ++i) {
+        const RequestParameters& params = cmds[i];
+        if (params.mode == RequestParameters::Mode::Kelvin) {
+            errors[i] = "Kelvin not supported";
+            return false;
+        }
+
+        int& depth = (params.mode == RequestParameters::Mode::Raw) ? rawDepth : hsvDepth;
+        if (params.queue == QueuePolicy::Single || params.queue == QueuePolicy::FrontReset)
+            depth = 1;
+        else
+            ++depth;
+
+        if (depth > RGBWW_ANIMATIONQSIZE) {
+            errors[i] = "Queue full";
+            return false;
+        }
+    }
+    return true;
+}
+
+void JsonProcessor::appendCompact(String& str, const char* pJson, size_t length) {
+    // copy while dropping whitespace outside of strings
+    char quote = 0;
+    for (size_t i=0; i < length; ++i) {
+        const char c = pJson[i];
+        if (quote) {
+            str += c;
+            if (c == '\\' && i + 1 < length)
+                str += pJson[++i];
+            else if (c == quote)
+                quote = 0;
+        }
+        else if (c == '"' || c == '\'') {
+            quote = c;
+            str += c;
+        }
+        else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            str += c;
+        }
+    }
 }
 
 bool JsonProcessor::onColor(JsonObject& root, String& msg, bool relay) {
     bool result = false;
     if (root["cmds"].success()) {
-        Vector<String> errors;
-        // multi command post (needs testing)
-        const JsonArray& cmds = root["cmds"].asArray();
-        for(int i=0; i < cmds.size(); ++i) {
-            String msg;
-            if (!onSingleColorCommand(cmds[i], msg))
-                errors.add(msg);
+        const JsonArray& arr = root["cmds"].asArray();
+        if (arr.size() > _maxBatchCommands) {
+            msg = "Too many commands";
+            return false;
         }
 
-        if (errors.size() == 0)
-            result = true;
-        else {
-            String msg;
-            for (int i=0; i < errors.size(); ++i)
-                msg += errors[i] + "|";
-            result = false;
+        Vector<RequestParameters> cmds;
+        for(int i=0; i < arr.size(); ++i) {
+            RequestParameters params;
+            parseRequestParams(arr[i].asObject(), params);
+            cmds.add(params);
         }
+
+        // a batch that was not queued completely is not relayed either
+        Vector<String> errors;
+        if (!onColorBatch(cmds, errors)) {
+            msg = "Batch rejected";
+            return false;
+        }
+
+        result = true;
+        msg = "";
     }
     else {
         if (onSingleColorCommand(root, msg))
@@ -51,10 +330,7 @@ bool JsonProcessor::onStop(const String& json, String& msg, bool relay) {
 bool JsonProcessor::onStop(JsonObject& root, String& msg, bool relay) {
     RequestParameters params;
     JsonProcessor::parseRequestParams(root, params);
-    app.rgbwwctrl.clearAnimationQueue(params.channels);
-    app.rgbwwctrl.skipAnimation(params.channels);
-
-    onDirect(root, msg, false);
+    applyStop(params, msg);
 
     if (relay) {
         addChannelStatesToCmd(root, params.channels);
@@ -73,9 +349,7 @@ bool JsonProcessor::onSkip(const String& json, String& msg, bool relay) {
 bool JsonProcessor::onSkip(JsonObject& root, String& msg, bool relay) {
     RequestParameters params;
     JsonProcessor::parseRequestParams(root, params);
-    app.rgbwwctrl.skipAnimation(params.channels);
-
-    onDirect(root, msg, false);
+    applySkip(params, msg);
 
     if (relay) {
         addChannelStatesToCmd(root, params.channels);
@@ -94,10 +368,7 @@ bool JsonProcessor::onPause(const String& json, String& msg, bool relay) {
 bool JsonProcessor::onPause(JsonObject& root, String& msg, bool relay) {
     RequestParameters params;
     JsonProcessor::parseRequestParams(root, params);
-
-    app.rgbwwctrl.pauseAnimation(params.channels);
-
-    onDirect(root, msg, false);
+    applyPause(params, msg);
 
     if (relay) {
         addChannelStatesToCmd(root, params.channels);
@@ -116,6 +387,7 @@ bool JsonProcessor::onContinue(const String& json, String& msg, bool relay) {
 bool JsonProcessor::onContinue(JsonObject& root, String& msg, bool relay) {
     RequestParameters params;
     JsonProcessor::parseRequestParams(root, params);
+    app.rgbwwctrl.wake();
     app.rgbwwctrl.continueAnimation(params.channels);
 
     if (relay)
@@ -135,8 +407,7 @@ bool JsonProcessor::onBlink(JsonObject& root, String& msg, bool relay) {
     params.ramp.value = 500; //default
 
     JsonProcessor::parseRequestParams(root, params);
-
-    app.rgbwwctrl.blink(params.channels, params.ramp.value, params.queue, params.requeue, params.name);
+    applyBlink(params);
 
     if (relay)
         app.onCommandRelay("blink", root);
@@ -162,10 +433,15 @@ bool JsonProcessor::onToggle(JsonObject& root, String& msg, bool relay) {
 bool JsonProcessor::onSingleColorCommand(JsonObject& root, String& errorMsg) {
     RequestParameters params;
     parseRequestParams(root, params);
+    return onSingleColorCommand(params, errorMsg);
+}
+
+bool JsonProcessor::onSingleColorCommand(RequestParameters& params, String& errorMsg) {
     if (params.checkParams(errorMsg) != 0) {
         return false;
     }
 
+    app.rgbwwctrl.keepAwake(params.getMaxDurationMs());
     bool queueOk = false;
     if (params.mode == RequestParameters::Mode::Kelvin) {
         //TODO: hand to rgbctrl
@@ -200,15 +476,65 @@ bool JsonProcessor::onSingleColorCommand(JsonObject& root, String& errorMsg) {
 }
 
 bool JsonProcessor::onDirect(const String& json, String& msg, bool relay) {
-    DynamicJsonBuffer jsonBuffer;
-    JsonObject& root = jsonBuffer.parseObject(json);
-    return onDirect(root, msg, relay);
+    return onDirect(json.c_str(), json.length(), msg, relay);
+}
+
+bool JsonProcessor::onDirect(const char* pJson, size_t length, String& msg, bool relay) {
+    JsonPullParser parser(pJson, length);
+    RequestParameters params;
+    if (parser.next() != JsonPullParser::Token::ObjectStart || !parseRequestParams(parser, params)) {
+        msg = "Invalid json";
+        return false;
+    }
+
+    applyDirect(params, msg);
+
+    if (relay)
+        app.onCommandRelay("direct", pJson, length);
+
+    return true;
 }
 
 bool JsonProcessor::onDirect(JsonObject& root, String& msg, bool relay) {
     RequestParameters params;
     JsonProcessor::parseRequestParams(root, params);
 
+    applyDirect(params, msg);
+
+    if (relay)
+        app.onCommandRelay("direct", root);
+
+    return true;
+}
+
+void JsonProcessor::applyStop(RequestParameters& params, String& msg) {
+    app.rgbwwctrl.clearAnimationQueue(params.channels);
+    app.rgbwwctrl.skipAnimation(params.channels);
+    if (params.channels.count() == 0)
+        app.rgbwwctrl.onAnimationsCleared();
+    applyDirect(params, msg);
+}
+
+void JsonProcessor::applySkip(RequestParameters& params, String& msg) {
+    app.rgbwwctrl.skipAnimation(params.channels);
+    applyDirect(params, msg);
+}
+
+void JsonProcessor::applyPause(RequestParameters& params, String& msg) {
+    // the paused animations continue some time later
+    app.rgbwwctrl.keepAwake(APPLedCtrl::unknownDuration);
+    app.rgbwwctrl.pauseAnimation(params.channels);
+    applyDirect(params, msg);
+}
+
+void JsonProcessor::applyBlink(RequestParameters& params) {
+    // off and back on, each for ramp.value
+    app.rgbwwctrl.keepAwake(params.requeue ? APPLedCtrl::unknownDuration : static_cast<uint32_t>(2 * params.ramp.value));
+    app.rgbwwctrl.blink(params.channels, params.ramp.value, params.queue, params.requeue, params.name);
+}
+
+void JsonProcessor::applyDirect(RequestParameters& params, String& msg) {
+    app.rgbwwctrl.wake();
     if (params.mode == RequestParameters::Mode::Kelvin) {
         //TODO: hand to rgbctrl
     } else if (params.mode == RequestParameters::Mode::Hsv) {
@@ -218,11 +544,6 @@ bool JsonProcessor::onDirect(JsonObject& root, String& msg, bool relay) {
     } else {
         msg = "No color object!";
     }
-
-    if (relay)
-        app.onCommandRelay("direct", root);
-
-    return true;
 }
 
 void JsonProcessor::parseRequestParams(JsonObject& root, RequestParameters& params) {
@@ -240,13 +561,13 @@ void JsonProcessor::parseRequestParams(JsonObject& root, RequestParameters& para
         if (root["hsv"]["from"].success()) {
             params.hasHsvFrom = true;
             if (root["hsv"]["from"]["h"].success())
-                params.hsv.h = AbsOrRelValue(root["hsv"]["from"]["h"].asString(), AbsOrRelValue::Type::Hue);
+                params.hsvFrom.h = AbsOrRelValue(root["hsv"]["from"]["h"].asString(), AbsOrRelValue::Type::Hue);
             if (root["hsv"]["from"]["s"].success())
-                params.hsv.s = AbsOrRelValue(root["hsv"]["from"]["s"].asString());
+                params.hsvFrom.s = AbsOrRelValue(root["hsv"]["from"]["s"].asString());
             if (root["hsv"]["from"]["v"].success())
-                params.hsv.v = AbsOrRelValue(root["hsv"]["from"]["v"].asString());
+                params.hsvFrom.v = AbsOrRelValue(root["hsv"]["from"]["v"].asString());
             if (root["hsv"]["from"]["ct"].success())
-                params.hsv.ct = AbsOrRelValue(root["hsv"]["from"]["ct"].asString(), AbsOrRelValue::Type::Ct);
+                params.hsvFrom.ct = AbsOrRelValue(root["hsv"]["from"]["ct"].asString(), AbsOrRelValue::Type::Ct);
         }
     }
     else if (root["raw"].success()) {
@@ -346,6 +667,199 @@ void JsonProcessor::parseRequestParams(JsonObject& root, RequestParameters& para
     }
 }
 
+bool JsonProcessor::skipValue(JsonPullParser& parser, JsonPullParser::Token token) {
+    if (token == JsonPullParser::Token::ObjectStart || token == JsonPullParser::Token::ArrayStart)
+        return parser.skipContainer();
+    return token == JsonPullParser::Token::String || token == JsonPullParser::Token::Primitive;
+}
+
+bool JsonProcessor::parseRequestParams(JsonPullParser& parser, RequestParameters& params) {
+    for (;;) {
+        const JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            return true;
+        if (t != JsonPullParser::Token::Key || !parseRequestParam(parser, params))
+            return false;
+    }
+}
+
+bool JsonProcessor::parseRequestParam(JsonPullParser& parser, RequestParameters& params) {
+    // the parser is positioned after the key, the value is read here.
+    // Mode precedence is the same as for the DOM variant: kelvin > hsv > raw
+    if (parser.textEquals("hsv")) {
+        if (parser.next() != JsonPullParser::Token::ObjectStart)
+            return false;
+        if (params.mode != RequestParameters::Mode::Kelvin)
+            params.mode = RequestParameters::Mode::Hsv;
+        return parseHsv(parser, params.hsv, params);
+    }
+
+    if (parser.textEquals("raw")) {
+        if (parser.next() != JsonPullParser::Token::ObjectStart)
+            return false;
+        if (params.mode == RequestParameters::Mode::Undefined)
+            params.mode = RequestParameters::Mode::Raw;
+        return parseRaw(parser, params.raw, params);
+    }
+
+    if (parser.textEquals("channels")) {
+        if (parser.next() != JsonPullParser::Token::ArrayStart)
+            return false;
+        return parseChannels(parser, params.channels);
+    }
+
+    const bool isKelvin = parser.textEquals("kelvin");
+    const bool isT = parser.textEquals("t");
+    const bool isS = parser.textEquals("s");
+    const bool isR = parser.textEquals("r");
+    const bool isD = parser.textEquals("d");
+    const bool isName = parser.textEquals("name");
+    const bool isCmd = parser.textEquals("cmd");
+    const bool isQ = parser.textEquals("q");
+
+    const JsonPullParser::Token t = parser.next();
+    if (t != JsonPullParser::Token::String && t != JsonPullParser::Token::Primitive)
+        return skipValue(parser, t);
+
+    if (isKelvin) {
+        params.mode = RequestParameters::Mode::Kelvin;
+        params.kelvin = parser.getInt();
+    }
+    else if (isT) {
+        params.ramp.value = parser.getDouble();
+        params.ramp.type = RampTimeOrSpeed::Type::Time;
+    }
+    else if (isS) {
+        params.ramp.value = parser.getDouble();
+        params.ramp.type = RampTimeOrSpeed::Type::Speed;
+    }
+    else if (isR) {
+        params.requeue = parser.getInt() == 1;
+    }
+    else if (isD) {
+        params.direction = parser.getInt();
+    }
+    else if (isName) {
+        params.name = parser.getString();
+    }
+    else if (isCmd) {
+        params.cmd = parser.getString();
+    }
+    else if (isQ) {
+        if (parser.textEquals("back"))
+            params.queue = QueuePolicy::Back;
+        else if (parser.textEquals("front"))
+            params.queue = QueuePolicy::Front;
+        else if (parser.textEquals("front_reset"))
+            params.queue = QueuePolicy::FrontReset;
+        else if (parser.textEquals("single"))
+            params.queue = QueuePolicy::Single;
+        else
+            params.queue = QueuePolicy::Invalid;
+    }
+
+    return true;
+}
+
+bool JsonProcessor::parseHsv(JsonPullParser& parser, RequestHSVCT& hsv, RequestParameters& params) {
+    for (;;) {
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            return true;
+        if (t != JsonPullParser::Token::Key)
+            return false;
+
+        if (parser.textEquals("from") && &hsv == &params.hsv) {
+            if (parser.next() != JsonPullParser::Token::ObjectStart)
+                return false;
+            params.hasHsvFrom = true;
+            if (!parseHsv(parser, params.hsvFrom, params))
+                return false;
+            continue;
+        }
+
+        const bool isH = parser.textEquals("h");
+        const bool isS = parser.textEquals("s");
+        const bool isV = parser.textEquals("v");
+        const bool isCt = parser.textEquals("ct");
+
+        t = parser.next();
+        if (t != JsonPullParser::Token::String && t != JsonPullParser::Token::Primitive) {
+            if (!skipValue(parser, t))
+                return false;
+            continue;
+        }
+
+        if (isH)
+            hsv.h = AbsOrRelValue(parser.getString(), AbsOrRelValue::Type::Hue);
+        else if (isS)
+            hsv.s = AbsOrRelValue(parser.getString());
+        else if (isV)
+            hsv.v = AbsOrRelValue(parser.getString());
+        else if (isCt)
+            hsv.ct = AbsOrRelValue(parser.getString(), AbsOrRelValue::Type::Ct);
+    }
+}
+
+bool JsonProcessor::parseRaw(JsonPullParser& parser, RequestChannelOutput& raw, RequestParameters& params) {
+    for (;;) {
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            return true;
+        if (t != JsonPullParser::Token::Key)
+            return false;
+
+        if (parser.textEquals("from") && &raw == &params.raw) {
+            if (parser.next() != JsonPullParser::Token::ObjectStart)
+                return false;
+            params.hasRawFrom = true;
+            if (!parseRaw(parser, params.rawFrom, params))
+                return false;
+            continue;
+        }
+
+        AbsOrRelValue* pValue = nullptr;
+        if (parser.textEquals("r"))
+            pValue = &raw.r;
+        else if (parser.textEquals("g"))
+            pValue = &raw.g;
+        else if (parser.textEquals("b"))
+            pValue = &raw.b;
+        else if (parser.textEquals("ww"))
+            pValue = &raw.ww;
+        else if (parser.textEquals("cw"))
+            pValue = &raw.cw;
+
+        t = parser.next();
+        if (pValue && (t == JsonPullParser::Token::String || t == JsonPullParser::Token::Primitive))
+            *pValue = AbsOrRelValue(parser.getString(), AbsOrRelValue::Type::Raw);
+        else if (!skipValue(parser, t))
+            return false;
+    }
+}
+
+bool JsonProcessor::parseChannels(JsonPullParser& parser, RGBWWLed::ChannelList& channels) {
+    for (;;) {
+        const JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ArrayEnd)
+            return true;
+        if (t != JsonPullParser::Token::String && t != JsonPullParser::Token::Primitive) {
+            if (!skipValue(parser, t))
+                return false;
+            continue;
+        }
+
+        if (parser.textEquals("h"))
+            channels.add(CtrlChannel::Hue);
+        else if (parser.textEquals("s"))
+            channels.add(CtrlChannel::Sat);
+        else if (parser.textEquals("v"))
+            channels.add(CtrlChannel::Val);
+        else if (parser.textEquals("ct"))
+            channels.add(CtrlChannel::ColorTemp);
+    }
+}
+
 int JsonProcessor::RequestParameters::checkParams(String& errorMsg) const {
     if (mode == Mode::Hsv) {
         if (hsv.ct.hasValue()) {
@@ -390,31 +904,246 @@ int JsonProcessor::RequestParameters::checkParams(String& errorMsg) const {
     return 0;
 }
 
+uint32_t JsonProcessor::RequestParameters::getMaxDurationMs() const {
+    // requeued animations run until stopped, a fade at a given speed takes
+    // as long as the distance from the color it starts at
+    if (requeue || ramp.type == RampTimeOrSpeed::Type::Speed)
+        return APPLedCtrl::unknownDuration;
+    return static_cast<uint32_t>(ramp.value);
+}
+
 bool JsonProcessor::onJsonRpc(const String& json) {
     debug_d("JsonProcessor::onJsonRpc: %s\n", json.c_str());
-    JsonRpcMessageIn rpc(json);
+
+    // only locate method and params here. color and direct (the bulk of the
+    // relayed commands) are handled by the streaming parser directly on the params span
+    JsonPullParser parser(json.c_str(), json.length());
+    if (parser.next() != JsonPullParser::Token::ObjectStart)
+        return false;
+
+    String method;
+    size_t paramsStart = 0;
+    size_t paramsLength = 0;
+    bool hasStartStep = false;
+    uint32_t startStep = 0;
+    for (;;) {
+        JsonPullParser::Token t = parser.next();
+        if (t == JsonPullParser::Token::ObjectEnd)
+            break;
+        if (t != JsonPullParser::Token::Key)
+            return false;
+
+        if (parser.textEquals("method")) {
+            t = parser.next();
+            if (t != JsonPullParser::Token::String)
+                return false;
+            method = parser.getString();
+        }
+        else if (parser.textEquals("params")) {
+            paramsStart = parser.getValueStart();
+            if (!parser.skipValue())
+                return false;
+            paramsLength = parser.getPosition() - paramsStart;
+        }
+        else if (parser.textEquals("at")) {
+            // master step on which a color command starts
+            if (parser.next() != JsonPullParser::Token::Primitive)
+                return false;
+            startStep = strtoul(parser.getText(), nullptr, 10);
+            hasStartStep = true;
+        }
+        else if (!parser.skipValue()) {
+            return false;
+        }
+    }
+
+    const char* pParams = json.c_str() + paramsStart;
+    if (paramsLength == 0) {
+        pParams = "{}";
+        paramsLength = 2;
+    }
 
     String msg;
-    if (rpc.getMethod() == "color") {
-        return onColor(rpc.getParams(), msg, false);
+    if (method == "color") {
+        uint32_t localStep;
+        if (hasStartStep && app.rgbwwctrl.toLocalStep(startStep, localStep))
+            return scheduleColor(localStep, pParams, paramsLength, msg);
+        return onColor(pParams, paramsLength, msg, false);
     }
-    else if (rpc.getMethod() == "stop") {
-        return onStop(rpc.getParams(), msg, false);
+    else if (method == "direct") {
+        return onDirect(pParams, paramsLength, msg, false);
     }
-    else if (rpc.getMethod() == "blink") {
-        return onBlink(rpc.getParams(), msg, false);
+
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& params = jsonBuffer.parseObject(pParams);
+    if (method == "stop") {
+        return onStop(params, msg, false);
     }
-    else if (rpc.getMethod() == "skip") {
-        return onSkip(rpc.getParams(), msg, false);
+    else if (method == "blink") {
+        return onBlink(params, msg, false);
     }
-    else if (rpc.getMethod() == "pause") {
-        return onPause(rpc.getParams(), msg, false);
+    else if (method == "skip") {
+        return onSkip(params, msg, false);
     }
-    else if (rpc.getMethod() == "continue") {
-        return onContinue(rpc.getParams(), msg, false);
+    else if (method == "pause") {
+        return onPause(params, msg, false);
     }
-    else if (rpc.getMethod() == "direct") {
-        return onDirect(rpc.getParams(), msg, false);
+    else if (method == "continue") {
+        return onContinue(params, msg, false);
+    }
+    return false;
+}
+
+bool JsonProcessor::onRelayedCommand(const String& msg) {
+    // slaves accept both encodings, the master decides which one is sent
+    if (BinaryCommand::isBinary(msg))
+        return onBinaryCommand(msg);
+    return onJsonRpc(msg);
+}
+
+bool JsonProcessor::onBinaryCommand(const String& msg) {
+    BinaryCommand::Method method;
+    Vector<BinaryCommand::Record> records;
+    if (!BinaryCommand::decode(msg, method, records)) {
+        debug_w("JsonProcessor::onBinaryCommand: invalid message (%d bytes)", msg.length());
+        return false;
+    }
+
+    String errorMsg;
+    if (method == BinaryCommand::Method::Color && records.count() > 1) {
+        Vector<RequestParameters> cmds;
+        for (int i=0; i < records.count(); ++i) {
+            RequestParameters params;
+            applyRecord(records[i], params);
+            cmds.add(params);
+        }
+
+        Vector<String> errors;
+        return onColorBatch(cmds, errors);
+    }
+
+    RequestParameters params;
+    if (method == BinaryCommand::Method::Blink)
+        params.ramp.value = 500; //default
+    if (records.count() > 0)
+        applyRecord(records[0], params);
+
+    switch (method) {
+    case BinaryCommand::Method::Color:
+        return onSingleColorCommand(params, errorMsg);
+    case BinaryCommand::Method::Direct:
+        applyDirect(params, errorMsg);
+        return true;
+    case BinaryCommand::Method::Stop:
+        applyStop(params, errorMsg);
+        return true;
+    case BinaryCommand::Method::Skip:
+        applySkip(params, errorMsg);
+        return true;
+    case BinaryCommand::Method::Pause:
+        applyPause(params, errorMsg);
+        return true;
+    case BinaryCommand::Method::Continue:
+        app.rgbwwctrl.wake();
+        app.rgbwwctrl.continueAnimation(params.channels);
+        return true;
+    case BinaryCommand::Method::Blink:
+        applyBlink(params);
+        return true;
+    case BinaryCommand::Method::Toggle:
+        app.rgbwwctrl.toggle();
+        return true;
+    default:
+        return false;
+    }
+}
+
+AbsOrRelValue JsonProcessor::toAbsOrRelValue(const BinaryCommand::Record& record, int group, int component, AbsOrRelValue::Type type) {
+    // fixed point (value * 100) in the units of the JSON API, scaled to the
+    // internal range the way the string constructor of AbsOrRelValue does
+    const int32_t value = record.values[group][component];
+    int32_t internal;
+    switch (type) {
+    case AbsOrRelValue::Type::Hue:
+        internal = static_cast<int64_t>(value) * RGBWW_CALC_HUEWHEELMAX / (360 * BinaryCommand::fixedPointScale);
+        break;
+    case AbsOrRelValue::Type::Percent:
+        internal = static_cast<int64_t>(value) * RGBWW_CALC_MAXVAL / (100 * BinaryCommand::fixedPointScale);
+        break;
+    default:
+        internal = value / BinaryCommand::fixedPointScale;
+        break;
+    }
+
+    const AbsOrRelValue::Mode mode = record.isRelative(group, component) ? AbsOrRelValue::Mode::Relative : AbsOrRelValue::Mode::Absolute;
+    return AbsOrRelValue(internal, mode);
+}
+
+void JsonProcessor::applyRecord(const BinaryCommand::Record& record, RequestParameters& params) {
+    typedef BinaryCommand BC;
+    if (record.flags & BC::FlagHsv) {
+        params.mode = RequestParameters::Mode::Hsv;
+        params.hasHsvFrom = record.present[BC::GroupHsv] & BC::fromBit;
+        for (int g=BC::GroupHsv; g <= BC::GroupHsvFrom; ++g) {
+            RequestHSVCT& hsv = (g == BC::GroupHsv) ? params.hsv : params.hsvFrom;
+            if (record.hasValue(g, 0))
+                hsv.h = toAbsOrRelValue(record, g, 0, AbsOrRelValue::Type::Hue);
+            if (record.hasValue(g, 1))
+                hsv.s = toAbsOrRelValue(record, g, 1, AbsOrRelValue::Type::Percent);
+            if (record.hasValue(g, 2))
+                hsv.v = toAbsOrRelValue(record, g, 2, AbsOrRelValue::Type::Percent);
+            if (record.hasValue(g, 3))
+                hsv.ct = toAbsOrRelValue(record, g, 3, AbsOrRelValue::Type::Ct);
+        }
+    }
+    if (record.flags & BC::FlagRaw) {
+        if (params.mode == RequestParameters::Mode::Undefined)
+            params.mode = RequestParameters::Mode::Raw;
+        params.hasRawFrom = record.present[BC::GroupRaw] & BC::fromBit;
+        for (int g=BC::GroupRaw; g <= BC::GroupRawFrom; ++g) {
+            RequestChannelOutput& raw = (g == BC::GroupRaw) ? params.raw : params.rawFrom;
+            AbsOrRelValue* values[] = {&raw.r, &raw.g, &raw.b, &raw.ww, &raw.cw};
+            for (int c=0; c < BC::numComponents; ++c) {
+                if (record.hasValue(g, c))
+                    *values[c] = toAbsOrRelValue(record, g, c, AbsOrRelValue::Type::Raw);
+            }
+        }
+    }
+
+    if (record.flags & BC::FlagRamp) {
+        params.ramp.value = double(record.ramp) / BC::fixedPointScale;
+        params.ramp.type = (record.flags & BC::FlagSpeed) ? RampTimeOrSpeed::Type::Speed : RampTimeOrSpeed::Type::Time;
+    }
+
+    params.requeue = record.flags & BC::FlagRequeue;
+    if (record.flags & BC::FlagDirection)
+        params.direction = record.direction;
+    if (record.flags & BC::FlagName)
+        params.name = record.name;
+    if (record.flags & BC::FlagFade)
+        params.cmd = "fade";
+
+    switch (record.queue) {
+    case BC::QueueSingle:
+        params.queue = QueuePolicy::Single;
+        break;
+    case BC::QueueBack:
+        params.queue = QueuePolicy::Back;
+        break;
+    case BC::QueueFront:
+        params.queue = QueuePolicy::Front;
+        break;
+    case BC::QueueFrontReset:
+        params.queue = QueuePolicy::FrontReset;
+        break;
+    default:
+        break;
+    }
+
+    const CtrlChannel channels[] = {CtrlChannel::Hue, CtrlChannel::Sat, CtrlChannel::Val, CtrlChannel::ColorTemp};
+    for (int i=0; i < 4; ++i) {
+        if (record.channels & (1 << i))
+            params.channels.add(channels[i]);
     }
 }
 
@@ -0,0 +1,220 @@
+#include <RGBWWCtrl.h>
+
+JsonPullParser::JsonPullParser(const char* pData, size_t length) : _pData(pData), _length(length) {
+}
+
+bool JsonPullParser::inObject() const {
+    return _depth > 0 && (_objectStack & (1u << (_depth - 1)));
+}
+
+void JsonPullParser::skipWhitespace() {
+    while (_pos < _length) {
+        const char c = _pData[_pos];
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            break;
+        ++_pos;
+    }
+}
+
+void JsonPullParser::skipSeparators() {
+    skipWhitespace();
+    while (_pos < _length && (_pData[_pos] == ',' || _pData[_pos] == ':')) {
+        if (_pData[_pos] == ',')
+            _expectKey = inObject();
+        ++_pos;
+        skipWhitespace();
+    }
+}
+
+size_t JsonPullParser::getValueStart() {
+    skipSeparators();
+    return _pos;
+}
+
+JsonPullParser::Token JsonPullParser::next() {
+    skipSeparators();
+
+    if (_pos >= _length || _pData[_pos] == '\0')
+        return (_depth == 0) ? Token::End : Token::Error;
+
+    const char c = _pData[_pos];
+    switch (c) {
+    case '{':
+    case '[':
+        if (_depth >= _maxDepth)
+            return Token::Error;
+
+        if (c == '{')
+            _objectStack |= (1u << _depth);
+        else
+            _objectStack &= ~(1u << _depth);
+        ++_depth;
+        ++_pos;
+        _expectKey = (c == '{');
+        return (c == '{') ? Token::ObjectStart : Token::ArrayStart;
+
+    case '}':
+    case ']':
+        if (_depth == 0 || inObject() != (c == '}'))
+            return Token::Error;
+
+        --_depth;
+        ++_pos;
+        _expectKey = false;
+        return (c == '}') ? Token::ObjectEnd : Token::ArrayEnd;
+
+    case '"':
+    case '\'':
+        return scanString(c);
+
+    default:
+        return scanPrimitive();
+    }
+}
+
+JsonPullParser::Token JsonPullParser::scanString(char quote) {
+    const size_t start = ++_pos;
+    while (_pos < _length && _pData[_pos] != quote) {
+        if (_pData[_pos] == '\\')
+            ++_pos;
+        ++_pos;
+    }
+
+    if (_pos >= _length)
+        return Token::Error;
+
+    _textStart = start;
+    _textLength = _pos - start;
+    ++_pos;
+
+    if (_expectKey) {
+        _expectKey = false;
+        return Token::Key;
+    }
+    return Token::String;
+}
+
+JsonPullParser::Token JsonPullParser::scanPrimitive() {
+    const size_t start = _pos;
+    while (_pos < _length) {
+        const char c = _pData[_pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ':' ||
+                c == '{' || c == '}' || c == '[' || c == ']' || c == '"' || c == '\'' || c == '\0')
+            break;
+        ++_pos;
+    }
+
+    if (_pos == start)
+        return Token::Error;
+
+    _textStart = start;
+    _textLength = _pos - start;
+
+    if (_expectKey) {
+        _expectKey = false;
+        return Token::Key;
+    }
+    return Token::Primitive;
+}
+
+bool JsonPullParser::skipValue() {
+    const Token t = next();
+    if (t == Token::ObjectStart || t == Token::ArrayStart)
+        return skipContainer();
+    return t == Token::String || t == Token::Primitive;
+}
+
+bool JsonPullParser::skipContainer() {
+    const int depth = _depth;
+    while (_depth >= depth) {
+        const Token t = next();
+        if (t == Token::Error || t == Token::End)
+            return false;
+    }
+    return true;
+}
+
+bool JsonPullParser::textEquals(const char* str) const {
+    const size_t len = strlen(str);
+    return len == _textLength && memcmp(getText(), str, len) == 0;
+}
+
+size_t JsonPullParser::getString(char* pBuf, size_t size) const {
+    if (size == 0)
+        return 0;
+
+    size_t len = 0;
+    const char* pText = getText();
+    for (size_t i=0; i < _textLength && len < size - 1; ++i) {
+        char c = pText[i];
+        if (c == '\\' && i + 1 < _textLength) {
+            c = pText[++i];
+            switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u':
+                // only ASCII is resolved
+                if (i + 4 < _textLength) {
+                    char hex[5] = {pText[i + 1], pText[i + 2], pText[i + 3], pText[i + 4], '\0'};
+                    const long code = strtol(hex, nullptr, 16);
+                    c = (code < 0x80) ? static_cast<char>(code) : '?';
+                    i += 4;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        pBuf[len++] = c;
+    }
+    pBuf[len] = '\0';
+    return len;
+}
+
+String JsonPullParser::getString() const {
+    String str;
+    if (!str.reserve(_textLength))
+        return str;
+
+    char buf[33];
+    // resolve escapes chunk wise. Escapes are never split as long as the chunk is bigger than 6 chars
+    size_t i = 0;
+    const char* pText = getText();
+    while (i < _textLength) {
+        size_t chunk = std::min(_textLength - i, sizeof(buf) - 7);
+        // do not cut an escape sequence in half
+        while (i + chunk < _textLength && chunk > 0) {
+            size_t backslashes = 0;
+            while (backslashes < chunk && pText[i + chunk - 1 - backslashes] == '\\')
+                ++backslashes;
+            if (backslashes % 2 == 0)
+                break;
+            ++chunk;
+        }
+        JsonPullParser sub(pText + i, chunk);
+        sub._textStart = 0;
+        sub._textLength = chunk;
+        sub.getString(buf, sizeof(buf));
+        str += buf;
+        i += chunk;
+    }
+    return str;
+}
+
+int JsonPullParser::getInt() const {
+    if (textEquals("true"))
+        return 1;
+
+    char buf[16];
+    getString(buf, sizeof(buf));
+    return strtol(buf, nullptr, 10);
+}
+
+double JsonPullParser::getDouble() const {
+    char buf[24];
+    getString(buf, sizeof(buf));
+    return atof(buf);
+}
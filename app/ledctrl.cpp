@@ -27,6 +27,9 @@
 #include <cstdlib>
 #include <algorithm>
 
+const int APPLedCtrl::_stableColorCheckMs;
+const uint32_t APPLedCtrl::unknownDuration;
+
 APPLedCtrl::~APPLedCtrl() {
     delete _stepSync;
     _stepSync = nullptr;
@@ -64,7 +67,13 @@ PinConfig APPLedCtrl::parsePinConfigString(String& pinStr) {
 void APPLedCtrl::init() {
     debug_i("APPLedCtrl::init");
 
-    _stepSync = new ClockCatchUp();
+    initStepSync();
+
+    // in the order of the profiler phases
+    app.eventserver.registerTickTasks(_tickScheduler);
+    app.mqttclient.registerTickTasks(_tickScheduler);
+    _tickScheduler.addTask(&_stableColorCheckMs, TickScheduler::TaskDelegate(&APPLedCtrl::checkStableColorState, this), TickProfiler::PhaseStableColor);
+    _tickScheduler.addTask(&app.cfg.events.transfin_interval_ms, TickScheduler::TaskDelegate(&APPLedCtrl::publishFinishedStepAnimations, this), TickProfiler::PhaseTransFinished);
 
     const PinConfig pins = APPLedCtrl::parsePinConfigString(app.cfg.general.pin_config);
 
@@ -74,10 +83,8 @@ void APPLedCtrl::init() {
 
     HSVCT startupColor;
     if (app.cfg.color.startup_color == "last") {
-        colorStorage.load();
-        debug_i("H: %i | s: %i | v: %i | ct: %i", colorStorage.current.h, colorStorage.current.s, colorStorage.current.v, colorStorage.current.ct);
-
-        startupColor = colorStorage.current;
+        colorStorage.load(startupColor);
+        debug_i("H: %i | s: %i | v: %i | ct: %i", startupColor.h, startupColor.s, startupColor.v, startupColor.ct);
     } else {
         // interpret as color string
         startupColor = app.cfg.color.startup_color;
@@ -86,6 +93,7 @@ void APPLedCtrl::init() {
     // boot from off to startup color
     HSVCT startupColorDark = startupColor;
     startupColorDark.v = 0;
+    keepAwake(2000);
     fadeHSV(startupColorDark, startupColor, 2000); //fade to color in 700ms
 }
 
@@ -105,95 +113,157 @@ void APPLedCtrl::setup() {
     colorutils.setWhiteTemperature(app.cfg.color.colortemp.ww, app.cfg.color.colortemp.cw);
 }
 
-void APPLedCtrl::publishToEventServer() {
-    if (!app.cfg.events.server_enabled)
-        return;
-
-    HSVCT const * pHsv = NULL;
-    if (_mode == ColorMode::Hsv)
-        pHsv = &getCurrentColor();
-
-    app.eventserver.publishCurrentState(getCurrentOutput(), pHsv);
-}
-
-void APPLedCtrl::publishToMqtt() {
-    if (!app.cfg.sync.color_master_enabled)
-        return;
-
-    switch(_mode) {
-    case ColorMode::Hsv:
-        app.mqttclient.publishCurrentHsv(getCurrentColor());
-        break;
-    case ColorMode::Raw:
-        app.mqttclient.publishCurrentRaw(getCurrentOutput());
-        break;
-    }
-}
-
 void APPLedCtrl::updateLedCb(void* pTimerArg) {
     APPLedCtrl* pThis = static_cast<APPLedCtrl*>(pTimerArg);
     pThis->updateLed();
 }
 
 void APPLedCtrl::updateLed() {
-    // arm next timer
-    ets_timer_arm_new(&_ledTimer, _timerInterval, 0, 0);
+    const uint32_t tickStartUs = system_get_time();
+    _tickStartUs = tickStartUs;
+    _tickStats.onTickStart(tickStartUs);
+    if (!app.boottimeline.isComplete())
+        app.boottimeline.mark(BootTimeline::PhaseFirstTick);
 
-    const bool animFinished = show();
+    // steps covered by this tick, more than one while idle
+    const uint32_t numSteps = _tickSteps;
 
-    ++_stepCounter;
+    // arm next timer
+    _tickSteps = getTickSteps(_stepCounter + numSteps);
+    ets_timer_arm_new(&_ledTimer, _timerInterval * _tickSteps, 0, 0);
+    _tickStats.onTimerArmed(tickStartUs, _timerInterval * _tickSteps);
 
-    if (app.cfg.sync.clock_master_enabled) {
-        if ((_stepCounter % (app.cfg.sync.clock_master_interval * RGBWW_UPDATEFREQUENCY)) == 0) {
-            app.mqttclient.publishClock(_stepCounter);
-        }
-    }
+    _tickProfiler.beginTick();
 
-    const static uint32_t stepLenMs = 1000 / RGBWW_UPDATEFREQUENCY;
+    if (_numScheduled > 0)
+        runScheduledCommands();
+    _tickProfiler.endPhase(TickProfiler::PhaseScheduled);
 
-    if (app.cfg.events.color_interval_ms >= 0) {
-        if (animFinished || app.cfg.events.color_interval_ms == 0 ||
-                ((stepLenMs * _stepCounter) % app.cfg.events.color_interval_ms) < stepLenMs) {
+    // nothing is queued while idle. A tick cut short by wake() shows the
+    // step it ends on, the animation queued by the waking command starts there
+    bool animFinished = false;
+    if (!_idle)
+        animFinished = show();
+    _tickProfiler.endPhase(TickProfiler::PhaseShow);
 
-            uint32_t now = millis();
-            if (now - _lastColorEvent >= app.cfg.events.color_mininterval_ms) {
-                _lastColorEvent = now;
-                publishToEventServer();
-            }
+    const uint32_t prevStepCounter = _stepCounter;
+    _stepCounter += numSteps;
+
+    if (app.cfg.sync.clock_master_enabled) {
+        // the clock stays on step boundaries, idle ticks end on the clock step (see getTickSteps())
+        const uint32_t clockSteps = app.cfg.sync.clock_master_interval * RGBWW_UPDATEFREQUENCY;
+        if (clockSteps > 0 && (_stepCounter / clockSteps) != (prevStepCounter / clockSteps)) {
+            app.mqttclient.publishClock(_stepCounter, system_get_time() - tickStartUs);
         }
     }
+    _tickProfiler.endPhase(TickProfiler::PhaseClockMaster);
 
-    if (animFinished || app.cfg.sync.color_master_interval_ms == 0 ||
-            ((stepLenMs * _stepCounter) % app.cfg.sync.color_master_interval_ms) < stepLenMs) {
-        publishToMqtt();
-    }
+    _tickScheduler.run(millis(), animFinished, _tickProfiler);
 
-    checkStableColorState();
+    checkQuiet(animFinished, numSteps);
 
-    if (app.cfg.events.transfin_interval_ms >= 0) {
-        if (app.cfg.events.transfin_interval_ms == 0 ||
-                ((stepLenMs * _stepCounter) % app.cfg.events.transfin_interval_ms) < stepLenMs) {
-            publishFinishedStepAnimations();
-        }
-    }
+    _tickProfiler.endTick();
+    _tickStats.onTickEnd(system_get_time(), _timerInterval * numSteps);
+}
+
+void APPLedCtrl::startTickProfile(uint32_t numTicks, bool sweep) {
+    _tickProfiler.start(numTicks, sweep);
 }
 
 void APPLedCtrl::checkStableColorState() {
 	if (app.cfg.color.startup_color != "last")
 		return;
 
+    const uint32_t now = millis();
     if (_prevColor == getCurrentColor())
     {
-        ++_numStableColorSteps;
+        // save once the color was stable for _saveAfterStableColorMs
+        if (!_stableColorSaved && now - _stableColorSinceMs >= _saveAfterStableColorMs) {
+            _stableColorSaved = true;
+            colorSave();
+        }
     }
     else {
         _prevColor = getCurrentColor();
-        _numStableColorSteps = 0;
+        _stableColorSinceMs = now;
+        _stableColorSaved = false;
+    }
+}
+
+void APPLedCtrl::checkQuiet(bool animFinished, uint32_t numSteps) {
+    const ChannelOutput& output = getCurrentOutput();
+    const bool unchanged = !animFinished && output == _prevOutput;
+    _prevOutput = output;
+
+    // a clock slave steers every tick and scheduled commands need their exact step
+    if (!unchanged || _numScheduled > 0 || app.cfg.sync.clock_slave_enabled) {
+        wake();
+        return;
+    }
+
+    _numQuietSteps += numSteps;
+    const bool busy = _busyUnbounded || static_cast<int32_t>(_busyUntilStep - _stepCounter) > 0;
+    if (!_idle && !busy && _numQuietSteps * RGBWW_MINTIMEDIFF >= _idleAfterQuietMs) {
+        debug_d("APPLedCtrl: idle");
+        _idle = true;
     }
+}
+
+uint32_t APPLedCtrl::getTickSteps(uint32_t stepCounter) const {
+    if (!_idle)
+        return 1;
 
-    // save if color was stable for _saveAfterStableColorMs
-    if (abs(_saveAfterStableColorMs - (_numStableColorSteps * RGBWW_MINTIMEDIFF)) <= (RGBWW_MINTIMEDIFF / 2))
-        colorSave();
+    uint32_t steps = _idleTickSteps;
+    if (app.cfg.sync.clock_master_enabled) {
+        // end the tick on the step the clock is published on, so its phase stays valid
+        const uint32_t period = app.cfg.sync.clock_master_interval * RGBWW_UPDATEFREQUENCY;
+        if (period > 0) {
+            const uint32_t toClock = period - (stepCounter % period);
+            if (toClock < steps)
+                steps = toClock;
+        }
+    }
+    return steps;
+}
+
+void APPLedCtrl::wake() {
+    _numQuietSteps = 0;
+    if (!_idle)
+        return;
+
+    debug_d("APPLedCtrl: wake");
+    _idle = false;
+
+    // cut the armed idle tick short at the next step boundary, it covers
+    // the steps up to there
+    const uint32_t elapsedUs = system_get_time() - _tickStartUs;
+    const uint32_t steps = elapsedUs / _timerInterval + 1;
+    if (steps < _tickSteps) {
+        _tickSteps = steps;
+        ets_timer_disarm(&_ledTimer);
+        ets_timer_arm_new(&_ledTimer, steps * _timerInterval - elapsedUs, 0, 0);
+        _tickStats.onTimerArmed(_tickStartUs, steps * _timerInterval);
+    }
+}
+
+void APPLedCtrl::keepAwake(uint32_t maxDurationMs) {
+    wake();
+    if (maxDurationMs == unknownDuration) {
+        _busyUnbounded = true;
+        return;
+    }
+
+    // the animation starts with the tick armed now. Queued behind others or
+    // in front of them, it ends at most its duration after all of them
+    const uint32_t startStep = _stepCounter + _tickSteps;
+    if (static_cast<int32_t>(startStep - _busyUntilStep) > 0)
+        _busyUntilStep = startStep;
+    _busyUntilStep += maxDurationMs / RGBWW_MINTIMEDIFF + 1;
+}
+
+void APPLedCtrl::onAnimationsCleared() {
+    _busyUnbounded = false;
+    _busyUntilStep = _stepCounter;
 }
 
 void APPLedCtrl::publishFinishedStepAnimations() {
@@ -206,19 +276,118 @@ void APPLedCtrl::publishFinishedStepAnimations() {
     _stepFinishedAnimations.clear();
 }
 
+void APPLedCtrl::initStepSync() {
+    delete _stepSync;
+    if (app.cfg.sync.clock_slave_algorithm == "pi") {
+        debug_i("APPLedCtrl: clock slave algorithm: PI servo");
+        _stepSync = new ClockPIServo();
+    }
+    else {
+        _stepSync = new ClockCatchUp();
+    }
+    _timerInterval = _stepSync->reset();
+}
+
 void APPLedCtrl::onMasterClockReset() {
     _timerInterval = _stepSync->reset();
+    _transitFilter.reset();
+    _numMasterOffsets = 0;
+    _nextMasterOffset = 0;
+    _hasMasterClock = false;
     publishStatus();
 }
 
+void APPLedCtrl::updateMasterStepOffset(uint32_t stepsMaster) {
+    _masterOffsets[_nextMasterOffset] = stepsMaster - _stepCounter;
+    _nextMasterOffset = (_nextMasterOffset + 1) % _offsetWindow;
+    if (_numMasterOffsets < _offsetWindow)
+        ++_numMasterOffsets;
+
+    // compare as differences, the offsets wrap with the step counters
+    _masterStepOffset = _masterOffsets[0];
+    for (int i=1; i < _numMasterOffsets; ++i) {
+        if (static_cast<int32_t>(_masterOffsets[i] - _masterStepOffset) > 0)
+            _masterStepOffset = _masterOffsets[i];
+    }
+    _hasMasterClock = true;
+}
+
 void APPLedCtrl::onMasterClock(uint32_t stepsMaster) {
-    _timerInterval = _stepSync->onMasterClock(_stepCounter, stepsMaster);
+    updateMasterStepOffset(stepsMaster);
+    setSyncInterval(_stepSync->onMasterClock(_stepCounter, stepsMaster));
+}
+
+void APPLedCtrl::onMasterClock(uint32_t stepsMaster, uint32_t sentUs, uint32_t phaseUs, uint32_t receivedUs) {
+    // the master was phaseUs into its step when sending and the message spent
+    // delayUs longer in transit than the fastest recent one. Both steppers count
+    // at the same point of the tick, so the difference of the phases is the
+    // fraction of a step the master is ahead
+    const uint32_t delayUs = _transitFilter.onMessage(sentUs, receivedUs);
+    const int32_t localPhaseUs = receivedUs - _tickStartUs;
+    const float masterAhead = static_cast<float>(static_cast<int32_t>(phaseUs + delayUs) - localPhaseUs) / RGBWW_MINTIMEDIFF_US;
+    debug_d("APPLedCtrl::onMasterClock: steps: %d | phase: %d | delay: %d | local phase: %d\n", stepsMaster, phaseUs, delayUs, localPhaseUs);
+
+    updateMasterStepOffset(stepsMaster + lroundf(masterAhead));
+    setSyncInterval(_stepSync->onMasterClockTimed(_stepCounter, stepsMaster, masterAhead));
+}
+
+void APPLedCtrl::setSyncInterval(uint32_t interval) {
+    _timerInterval = interval;
 
     // limit interval to sane values (just for safety)
     _timerInterval = std::min(std::max(_timerInterval, RGBWW_MINTIMEDIFF_US / 2u), static_cast<uint32_t>(RGBWW_MINTIMEDIFF_US * 1.5));
     publishStatus();
 }
 
+bool APPLedCtrl::toLocalStep(uint32_t masterStep, uint32_t& localStep) const {
+    if (!app.cfg.sync.clock_slave_enabled || !_hasMasterClock)
+        return false;
+
+    localStep = masterStep - _masterStepOffset;
+    return true;
+}
+
+bool APPLedCtrl::scheduleColorCommands(uint32_t step, const Vector<JsonProcessor::RequestParameters>& cmds) {
+    // late or implausible start steps are executed right away by the caller
+    const int32_t ahead = step - _stepCounter;
+    if (ahead <= 0 || ahead > static_cast<int32_t>(_maxScheduleAheadSteps) || _numScheduled >= _maxScheduledCommands) {
+        debug_w("APPLedCtrl::scheduleColorCommands: not scheduled (step %u | ahead %d | queued %d)", step, ahead, _numScheduled);
+        return false;
+    }
+
+    wake();
+    ScheduledCommand* pCmd = _scheduledSlots;
+    while (pCmd->used)
+        ++pCmd;
+    pCmd->used = true;
+    pCmd->step = step;
+    for (int i=0; i < cmds.count(); ++i)
+        pCmd->cmds.add(cmds[i]);
+    _scheduled[_numScheduled++] = pCmd;
+    return true;
+}
+
+void APPLedCtrl::runScheduledCommands() {
+    int i = 0;
+    while (i < _numScheduled) {
+        if (static_cast<int32_t>(_stepCounter - _scheduled[i]->step) < 0) {
+            ++i;
+            continue;
+        }
+
+        ScheduledCommand* pCmd = _scheduled[i];
+        for (int j=i + 1; j < _numScheduled; ++j)
+            _scheduled[j - 1] = _scheduled[j];
+        _scheduled[--_numScheduled] = nullptr;
+
+        String msg;
+        if (!app.jsonproc.onScheduledColor(pCmd->cmds, msg))
+            debug_w("APPLedCtrl::runScheduledCommands: %s", msg.c_str());
+        pCmd->cmds.clear();
+        pCmd->used = false;
+    }
+}
+
 void APPLedCtrl::publishStatus() {
     app.eventserver.publishClockSlaveStatus(_stepSync->getCatchupOffset(), _timerInterval);
     app.mqttclient.publishClockSlaveOffset(_stepSync->getCatchupOffset());
@@ -228,8 +397,13 @@ void APPLedCtrl::publishStatus() {
 void APPLedCtrl::start() {
     debug_i("APPLedCtrl::start");
 
+    _idle = false;
+    _numQuietSteps = 0;
+    _tickSteps = 1;
+
     ets_timer_setfn(&_ledTimer, APPLedCtrl::updateLedCb, this);
     ets_timer_arm_new(&_ledTimer, _timerInterval, 0, 0);
+    _tickStats.onTimerArmed(system_get_time(), _timerInterval);
 }
 
 void APPLedCtrl::stop() {
@@ -238,17 +412,18 @@ void APPLedCtrl::stop() {
 }
 
 void APPLedCtrl::colorSave() {
-    colorStorage.current = getCurrentColor();
-    colorStorage.save();
+    colorStorage.save(getCurrentColor());
 }
 
 void APPLedCtrl::colorReset() {
     debug_i("APPLedCtrl::colorReset");
-    colorStorage.current.h = 0;
-    colorStorage.current.s = 0;
-    colorStorage.current.v = 0;
-    colorStorage.current.ct = 0;
-    colorStorage.save();
+    HSVCT color;
+    color.h = 0;
+    color.s = 0;
+    color.v = 0;
+    color.ct = 0;
+    colorStorage.save(color);
+    colorStorage.flush();
 }
 
 void APPLedCtrl::testChannels() {
@@ -282,6 +457,7 @@ void APPLedCtrl::onAnimationFinished(const String& name, bool requeued) {
 
 void APPLedCtrl::toggle() {
     static const int toggleFadeTime = 1000;
+    keepAwake(toggleFadeTime);
     switch (_mode) {
     case ColorMode::Hsv: {
         HSVCT current = getCurrentColor();
@@ -72,6 +72,12 @@ void AppMqttClient::connect() {
     // Assign a disconnect callback function
     mqtt->setCompleteDelegate(TcpClientCompleteDelegate(&AppMqttClient::onComplete, this));
 
+    updateTopics();
+
+    // the UDP sync channel replaces the sync topics
+    if (app.cfg.sync.udp_enabled)
+        return;
+
     if (app.cfg.sync.clock_slave_enabled) {
         mqtt->subscribe(app.cfg.sync.clock_slave_topic);
     }
@@ -85,9 +91,24 @@ void AppMqttClient::connect() {
 }
 
 void AppMqttClient::init() {
+    updateTopics();
+}
+
+void AppMqttClient::updateTopics() {
+    // also called after /config, which may have changed the device name
     if (app.cfg.general.device_name.length() > 0) {
         _id = app.cfg.general.device_name;
     }
+    else {
+        _id = String("rgbww_") + WifiStation.getMAC();
+    }
+
+    _topics[TopicColor] = buildTopic("color");
+    _topics[TopicClock] = buildTopic("clock");
+    _topics[TopicClockInterval] = buildTopic("clock_interval");
+    _topics[TopicClockSlaveOffset] = buildTopic("clock_slave_offset");
+    _topics[TopicCommand] = buildTopic("command");
+    _topics[TopicTransitionFinished] = buildTopic("transition_finished");
 }
 
 void AppMqttClient::start() {
@@ -114,12 +135,21 @@ void AppMqttClient::onMessageReceived(String topic, String message) {
             app.rgbwwctrl.onMasterClockReset();
         }
         else  {
-            uint32_t clock = message.toInt();
-            app.rgbwwctrl.onMasterClock(clock);
+            const uint32_t receivedUs = system_get_time();
+            char* pEnd = nullptr;
+            uint32_t clock = strtoul(message.c_str(), &pEnd, 10);
+            if (*pEnd == ',') {
+                const uint32_t sentUs = strtoul(pEnd + 1, &pEnd, 10);
+                const uint32_t phaseUs = (*pEnd == ',') ? strtoul(pEnd + 1, nullptr, 10) : 0;
+                app.rgbwwctrl.onMasterClock(clock, sentUs, phaseUs, receivedUs);
+            }
+            else {
+                app.rgbwwctrl.onMasterClock(clock);
+            }
         }
     }
     else if (app.cfg.sync.cmd_slave_enabled && topic == app.cfg.sync.cmd_slave_topic) {
-        app.jsonproc.onJsonRpc(message);
+        app.jsonproc.onRelayedCommand(message);
     }
     else if (app.cfg.sync.color_slave_enabled && (topic == app.cfg.sync.color_slave_topic)) {
         String error;
@@ -144,6 +174,37 @@ void AppMqttClient::publish(const String& topic, const String& data, bool retain
     }
 }
 
+void AppMqttClient::publishSync(Topic topic, const String& data, bool retain) {
+    // with the UDP channel enabled the sync payloads go to the multicast group instead
+    if (app.cfg.sync.udp_enabled) {
+        if (topic == TopicColor)
+            app.udpsync.sendColor(data);
+        else
+            app.udpsync.sendCommand(data);
+        return;
+    }
+
+    publish(_topics[topic], data, retain);
+}
+
+void AppMqttClient::registerTickTasks(TickScheduler& scheduler) {
+    scheduler.addTask(&app.cfg.sync.color_master_interval_ms, TickScheduler::TaskDelegate(&AppMqttClient::onColorTask, this), TickProfiler::PhaseMqtt, true);
+}
+
+void AppMqttClient::onColorTask() {
+    if (!app.cfg.sync.color_master_enabled)
+        return;
+
+    switch(app.rgbwwctrl.getMode()) {
+    case RGBWWLed::ColorMode::Hsv:
+        publishCurrentHsv(app.rgbwwctrl.getCurrentColor());
+        break;
+    case RGBWWLed::ColorMode::Raw:
+        publishCurrentRaw(app.rgbwwctrl.getCurrentOutput());
+        break;
+    }
+}
+
 void AppMqttClient::publishCurrentRaw(const ChannelOutput& raw) {
     if (raw == _lastRaw)
         return;
@@ -151,21 +212,13 @@ void AppMqttClient::publishCurrentRaw(const ChannelOutput& raw) {
 
     debug_d("ApplicationMQTTClient::publishCurrentRaw\n");
 
-    DynamicJsonBuffer jsonBuffer(200);
-    JsonObject& root = jsonBuffer.createObject();
-    JsonObject& rawJson = root.createNestedObject("raw");
-    rawJson["r"] = raw.r;
-    rawJson["g"] = raw.g;
-    rawJson["b"] = raw.b;
-    rawJson["cw"] = raw.cw;
-    rawJson["ww"] = raw.ww;
-
-    root["t"] = 0;
-    root["cmd"] = "solid";
+    char buf[ColorJson::maxRawLength + 32];
+    char* p = ColorJson::writeString(buf, "{\"raw\":");
+    p = ColorJson::writeRaw(p, raw);
+    p = ColorJson::writeString(p, ",\"t\":0,\"cmd\":\"solid\"}");
+    *p = '\0';
 
-    String jsonMsg;
-    root.printTo(jsonMsg);
-    publish(buildTopic("color"), jsonMsg, true);
+    publishSync(TopicColor, buf, true);
 }
 
 void AppMqttClient::publishCurrentHsv(const HSVCT& color) {
@@ -175,24 +228,14 @@ void AppMqttClient::publishCurrentHsv(const HSVCT& color) {
 
     debug_d("ApplicationMQTTClient::publishCurrentHsv\n");
 
-    float h, s, v;
-    int ct;
-    color.asRadian(h, s, v, ct);
+    // fixed point formatting, no soft float in the color master path
+    char buf[ColorJson::maxHsvLength + 32];
+    char* p = ColorJson::writeString(buf, "{\"hsv\":");
+    p = ColorJson::writeHsv(p, color);
+    p = ColorJson::writeString(p, ",\"t\":0,\"cmd\":\"solid\"}");
+    *p = '\0';
 
-    DynamicJsonBuffer jsonBuffer(200);
-    JsonObject& root = jsonBuffer.createObject();
-    JsonObject& hsv = root.createNestedObject("hsv");
-    hsv["h"] = h;
-    hsv["s"] = s;
-    hsv["v"] = v;
-    hsv["ct"] = ct;
-
-    root["t"] = 0;
-    root["cmd"] = "solid";
-
-    String jsonMsg;
-    root.printTo(jsonMsg);
-    publish(buildTopic("color"), jsonMsg, true);
+    publishSync(TopicColor, buf, true);
 }
 
 String AppMqttClient::buildTopic(const String& suffix) {
@@ -201,7 +244,12 @@ String AppMqttClient::buildTopic(const String& suffix) {
     return topic + suffix;
 }
 
-void AppMqttClient::publishClock(uint32_t steps) {
+void AppMqttClient::publishClock(uint32_t steps, uint32_t phaseUs) {
+    if (app.cfg.sync.udp_enabled) {
+        app.udpsync.sendClock(steps, phaseUs);
+        return;
+    }
+
     if (_firstClock) {
         this->publishClockReset();
         _firstClock = false;
@@ -209,32 +257,48 @@ void AppMqttClient::publishClock(uint32_t steps) {
     else {
         String msg;
         msg += steps;
+        if (app.cfg.sync.clock_master_timestamp) {
+            // old slaves only parse the leading step count
+            msg += ',';
+            msg += system_get_time();
+            msg += ',';
+            msg += phaseUs;
+        }
 
-        publish(buildTopic("clock"), msg, false);
+        publish(_topics[TopicClock], msg, false);
     }
 }
 
 void AppMqttClient::publishClockReset() {
-    publish(buildTopic("clock"), "reset", false);
+    publish(_topics[TopicClock], "reset", false);
 }
 
 void AppMqttClient::publishClockInterval(uint32_t curInterval) {
     String msg;
     msg += curInterval;
 
-    publish(buildTopic("clock_interval"), msg, false);
+    publish(_topics[TopicClockInterval], msg, false);
 }
 
 void AppMqttClient::publishClockSlaveOffset(uint32_t offset) {
     String msg;
     msg += offset;
 
-    publish(buildTopic("clock_slave_offset"), msg, false);
+    publish(_topics[TopicClockSlaveOffset], msg, false);
 }
 
 void AppMqttClient::publishCommand(const String& method, const JsonObject& params) {
     debug_d("ApplicationMQTTClient::publishCommand: %s\n", method.c_str());
 
+    if (app.cfg.sync.cmd_master_binary) {
+        String binMsg;
+        if (BinaryCommand::encode(method, params, binMsg)) {
+            publishSync(TopicCommand, binMsg, false);
+            return;
+        }
+        // not representable in binary -> JSON-RPC
+    }
+
     JsonRpcMessage msg(method);
 
     if (params.size() > 0)
@@ -242,7 +306,48 @@ void AppMqttClient::publishCommand(const String& method, const JsonObject& param
 
     String msgStr;
     msg.getRoot().printTo(msgStr);
-    publish(buildTopic("command"), msgStr, false);
+    publishSync(TopicCommand, msgStr, false);
+}
+
+void AppMqttClient::publishCommand(const String& method, const char* pParams, size_t length) {
+    debug_d("ApplicationMQTTClient::publishCommand: %s\n", method.c_str());
+
+    if (app.cfg.sync.cmd_master_binary) {
+        String binMsg;
+        if (BinaryCommand::encode(method, pParams, length, binMsg)) {
+            publishSync(TopicCommand, binMsg, false);
+            return;
+        }
+        // not representable in binary (kelvin, unknown keys...) -> JSON-RPC
+    }
+
+    publishJsonRpcCommand(method, pParams, length, nullptr);
+}
+
+void AppMqttClient::publishScheduledCommand(const String& method, const char* pParams, size_t length, uint32_t atStep) {
+    debug_d("ApplicationMQTTClient::publishScheduledCommand: %s at %u\n", method.c_str(), atStep);
+
+    // the start step is only part of the JSON-RPC envelope, never binary
+    publishJsonRpcCommand(method, pParams, length, &atStep);
+}
+
+void AppMqttClient::publishJsonRpcCommand(const String& method, const char* pParams, size_t length, const uint32_t* pAtStep) {
+    // params are already serialized, only the JSON-RPC envelope is added
+    String msgStr;
+    msgStr.reserve(length + method.length() + 64);
+    msgStr += "{\"jsonrpc\":\"2.0\",\"method\":\"";
+    msgStr += method;
+    msgStr += "\"";
+    if (length > 0) {
+        msgStr += ",\"params\":";
+        msgStr.concat(pParams, length);
+    }
+    if (pAtStep) {
+        msgStr += ",\"at\":";
+        msgStr += *pAtStep;
+    }
+    msgStr += "}";
+    publishSync(TopicCommand, msgStr, false);
 }
 
 void AppMqttClient::publishTransitionFinished(const String& name, bool requeued) {
@@ -255,5 +360,5 @@ void AppMqttClient::publishTransitionFinished(const String& name, bool requeued)
 
     String jsonMsg;
     root.printTo(jsonMsg);
-    publish(buildTopic("transition_finished"), jsonMsg, true);
+    publish(_topics[TopicTransitionFinished], jsonMsg, true);
 }
@@ -181,6 +181,10 @@ void AppWIFI::_STAGotIP(IPAddress ip, IPAddress mask, IPAddress gateway) {
     if(app.cfg.network.mqtt.enabled) {
         app.mqttclient.start();
     }
+
+    if (app.cfg.sync.udp_enabled) {
+        app.udpsync.start();
+    }
 }
 
 void AppWIFI::stopAp(int delay) {
@@ -74,9 +74,8 @@ void ApplicationOTA::afterOTA() {
         app.umountfs();
         app.mountfs(rom_slot);
 
-        // save settings / color into new rom space
+        // save settings into new rom space, the color log is shared by both roms
         app.cfg.save();
-        app.rgbwwctrl.colorSave();
 
         // save success to new rom
         saveStatus(OTASTATUS::OTA_SUCCESS);
@@ -0,0 +1,79 @@
+#include <RGBWWCtrl.h>
+
+namespace {
+    struct Slot {
+        // the stream first: it is constructed at the address of the slot
+        alignas(ResponseStream) uint8_t stream[sizeof(ResponseStream)];
+        char buffer[ResponseArena::bufferSize];
+    };
+
+    Slot slots[ResponseArena::numSlots];
+    bool slotInUse[ResponseArena::numSlots] = {false};
+}
+
+uint32_t ResponseArena::_numFallbacks = 0;
+
+ResponseStream::ResponseStream() :
+        _pBuffer(ResponseArena::getBuffer(this)) {
+}
+
+ResponseStream::ResponseStream(const char* pFlash, size_t length) :
+        _pBuffer(ResponseArena::getBuffer(this)), _pFlash(pFlash), _length(length) {
+}
+
+void* ResponseStream::operator new(size_t size) {
+    return ResponseArena::allocate();
+}
+
+void ResponseStream::operator delete(void* p) {
+    ResponseArena::release(p);
+}
+
+uint16_t ResponseStream::readMemoryBlock(char* data, int bufSize) {
+    const size_t len = std::min(static_cast<size_t>(bufSize), _length - _pos);
+    if (_pFlash)
+        memcpy_P(data, _pFlash + _pos, len);
+    else
+        memcpy(data, _pBuffer + _pos, len);
+    return len;
+}
+
+bool ResponseStream::seek(int len) {
+    if (len < 0 || _pos + len > _length)
+        return false;
+    _pos += len;
+    return true;
+}
+
+ResponseStream* ResponseArena::create() {
+    return new ResponseStream();
+}
+
+ResponseStream* ResponseArena::createStatic(const char* pFlash) {
+    return new ResponseStream(pFlash, strlen_P(pFlash));
+}
+
+void* ResponseArena::allocate() {
+    for (int i=0; i < numSlots; ++i) {
+        if (!slotInUse[i]) {
+            slotInUse[i] = true;
+            return &slots[i];
+        }
+    }
+
+    // more parallel responses than slots
+    ++_numFallbacks;
+    return ::operator new(sizeof(Slot));
+}
+
+void ResponseArena::release(void* pSlot) {
+    Slot* p = static_cast<Slot*>(pSlot);
+    if (p >= slots && p < slots + numSlots)
+        slotInUse[p - slots] = false;
+    else
+        ::operator delete(pSlot);
+}
+
+char* ResponseArena::getBuffer(void* pSlot) {
+    return static_cast<Slot*>(pSlot)->buffer;
+}
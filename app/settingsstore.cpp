@@ -0,0 +1,263 @@
+#include <RGBWWCtrl.h>
+
+const uint32_t SettingsStore::FileHeader::magic;
+const uint16_t SettingsStore::FileHeader::version;
+
+const SettingsStore::Section SettingsStore::sections[] = {
+    Section::Network,
+    Section::Color,
+    Section::Sync,
+    Section::Events,
+    Section::General,
+};
+
+void SettingsStore::Writer::write(const void* pData, size_t length) {
+    if (_length + length > _size) {
+        _overflow = true;
+        return;
+    }
+    memcpy(_pBuf + _length, pData, length);
+    _length += length;
+}
+
+void SettingsStore::Writer::operator()(bool& value) {
+    const uint8_t byte = value ? 1 : 0;
+    write(&byte, sizeof(byte));
+}
+
+void SettingsStore::Writer::operator()(int& value) {
+    const int32_t word = value;
+    write(&word, sizeof(word));
+}
+
+void SettingsStore::Writer::operator()(float& value) {
+    write(&value, sizeof(value));
+}
+
+void SettingsStore::Writer::operator()(IPAddress& value) {
+    const uint32_t addr = static_cast<uint32_t>(value);
+    write(&addr, sizeof(addr));
+}
+
+void SettingsStore::Writer::operator()(String& value) {
+    const uint16_t length = value.length();
+    write(&length, sizeof(length));
+    write(value.c_str(), length);
+}
+
+bool SettingsStore::Reader::read(void* pData, size_t length) {
+    if (_pos + length > _length) {
+        // the section was written by an older firmware, the rest keeps its defaults
+        _pos = _length;
+        return false;
+    }
+    memcpy(pData, _pData + _pos, length);
+    _pos += length;
+    return true;
+}
+
+void SettingsStore::Reader::operator()(bool& value) {
+    uint8_t byte;
+    if (read(&byte, sizeof(byte)))
+        value = byte != 0;
+}
+
+void SettingsStore::Reader::operator()(int& value) {
+    int32_t word;
+    if (read(&word, sizeof(word)))
+        value = word;
+}
+
+void SettingsStore::Reader::operator()(float& value) {
+    read(&value, sizeof(value));
+}
+
+void SettingsStore::Reader::operator()(IPAddress& value) {
+    uint32_t addr;
+    if (read(&addr, sizeof(addr)))
+        value = IPAddress(addr);
+}
+
+void SettingsStore::Reader::operator()(String& value) {
+    uint16_t length;
+    if (!read(&length, sizeof(length)))
+        return;
+    if (_pos + length > _length) {
+        _pos = _length;
+        return;
+    }
+    value = String();
+    value.concat(reinterpret_cast<const char*>(_pData + _pos), length);
+    _pos += length;
+}
+
+bool SettingsStore::exist() {
+    return fileExist(APP_SETTINGS_BINARY_FILE) || fileExist(APP_SETTINGS_BINARY_TEMP_FILE);
+}
+
+void SettingsStore::remove() {
+    if (fileExist(APP_SETTINGS_BINARY_FILE))
+        fileDelete(APP_SETTINGS_BINARY_FILE);
+    if (fileExist(APP_SETTINGS_BINARY_TEMP_FILE))
+        fileDelete(APP_SETTINGS_BINARY_TEMP_FILE);
+}
+
+void SettingsStore::recoverTempFile() {
+    if (!fileExist(APP_SETTINGS_BINARY_TEMP_FILE))
+        return;
+
+    // save() deletes the old file only once the new one is complete
+    if (fileExist(APP_SETTINGS_BINARY_FILE)) {
+        debug_w("SettingsStore: dropping incomplete %s", APP_SETTINGS_BINARY_TEMP_FILE);
+        fileDelete(APP_SETTINGS_BINARY_TEMP_FILE);
+    }
+    else {
+        debug_w("SettingsStore: completing the rename of %s", APP_SETTINGS_BINARY_TEMP_FILE);
+        fileRename(APP_SETTINGS_BINARY_TEMP_FILE, APP_SETTINGS_BINARY_FILE);
+    }
+}
+
+namespace {
+    bool readTable(file_t file, SettingsStore::FileHeader& header, SettingsStore::SectionEntry* pEntries, int maxEntries) {
+        if (fileRead(file, &header, sizeof(header)) != sizeof(header))
+            return false;
+        if (header.fileMagic != SettingsStore::FileHeader::magic || header.fileVersion != SettingsStore::FileHeader::version)
+            return false;
+        if (header.numSections > maxEntries)
+            return false;
+
+        const int tableSize = header.numSections * sizeof(SettingsStore::SectionEntry);
+        return fileRead(file, pEntries, tableSize) == tableSize;
+    }
+}
+
+bool SettingsStore::load(ApplicationSettings& cfg) {
+    recoverTempFile();
+
+    file_t file = fileOpen(APP_SETTINGS_BINARY_FILE, eFO_ReadOnly);
+    if (file < 0)
+        return false;
+
+    // room for sections added by a later firmware, they are skipped
+    const int maxEntries = 16;
+    FileHeader header;
+    SectionEntry entries[maxEntries];
+    if (!readTable(file, header, entries, maxEntries)) {
+        debug_e("SettingsStore::load: invalid header");
+        fileClose(file);
+        return false;
+    }
+
+    // one section in memory at a time
+    for (int i=0; i < header.numSections; ++i) {
+        const SectionEntry& entry = entries[i];
+        if (entry.version != sectionVersion || entry.length > maxSectionSize) {
+            debug_w("SettingsStore::load: skipping section %d (version %d)", entry.id, entry.version);
+            continue;
+        }
+
+        uint8_t* pData = new uint8_t[entry.length];
+        if (fileSeek(file, entry.offset, eSO_FileStart) < 0 || fileRead(file, pData, entry.length) != entry.length
+                || crc16(pData, entry.length) != entry.crc) {
+            debug_e("SettingsStore::load: section %d damaged, using defaults", entry.id);
+        }
+        else {
+            Reader reader(pData, entry.length);
+            cfg.visitSection(static_cast<Section>(entry.id), reader);
+        }
+        delete[] pData;
+    }
+
+    fileClose(file);
+    cfg.generation = header.generation;
+    return true;
+}
+
+bool SettingsStore::save(ApplicationSettings& cfg) {
+    uint8_t* pBuf = new uint8_t[maxSectionSize];
+
+    // layout of the new file
+    SectionEntry entries[numSections];
+    uint32_t offset = sizeof(FileHeader) + sizeof(entries);
+    for (int i=0; i < numSections; ++i) {
+        Writer writer(pBuf, maxSectionSize);
+        cfg.visitSection(sections[i], writer);
+        if (writer.isOverflow()) {
+            debug_e("SettingsStore::save: section %d too big", static_cast<int>(sections[i]));
+            delete[] pBuf;
+            return false;
+        }
+
+        SectionEntry& entry = entries[i];
+        entry.id = static_cast<uint8_t>(sections[i]);
+        entry.version = sectionVersion;
+        entry.length = writer.getLength();
+        entry.offset = offset;
+        entry.crc = crc16(pBuf, entry.length);
+        entry.reserved = 0;
+        offset += entry.length;
+    }
+
+    // unchanged layout: only the changed sections are written
+    FileHeader stored;
+    SectionEntry storedEntries[numSections];
+    recoverTempFile();
+    bool inPlace = false;
+    file_t file = fileOpen(APP_SETTINGS_BINARY_FILE, eFO_ReadWrite);
+    if (file >= 0) {
+        inPlace = readTable(file, stored, storedEntries, numSections) && stored.numSections == numSections;
+        for (int i=0; inPlace && i < numSections; ++i) {
+            inPlace = storedEntries[i].id == entries[i].id && storedEntries[i].version == entries[i].version
+                    && storedEntries[i].length == entries[i].length && storedEntries[i].offset == entries[i].offset;
+        }
+        if (!inPlace)
+            fileClose(file);
+    }
+    // a new layout goes to a new file, the old one stays valid until the rename
+    const char* pFileName = inPlace ? APP_SETTINGS_BINARY_FILE : APP_SETTINGS_BINARY_TEMP_FILE;
+    if (!inPlace)
+        file = fileOpen(pFileName, eFO_CreateNewAlways | eFO_WriteOnly);
+
+    if (file < 0) {
+        debug_e("SettingsStore::save: cannot open %s", pFileName);
+        delete[] pBuf;
+        return false;
+    }
+
+    int numWritten = 0;
+    for (int i=0; i < numSections; ++i) {
+        if (inPlace && storedEntries[i].crc == entries[i].crc)
+            continue;
+
+        Writer writer(pBuf, maxSectionSize);
+        cfg.visitSection(sections[i], writer);
+        fileSeek(file, entries[i].offset, eSO_FileStart);
+        fileWrite(file, pBuf, writer.getLength());
+        ++numWritten;
+    }
+    delete[] pBuf;
+
+    // the table last: a reset in between leaves a section with a bad CRC, not a bad layout
+    FileHeader header;
+    header.fileMagic = FileHeader::magic;
+    header.fileVersion = FileHeader::version;
+    header.numSections = numSections;
+    header.generation = ++cfg.generation;
+    fileSeek(file, 0, eSO_FileStart);
+    fileWrite(file, &header, sizeof(header));
+    fileWrite(file, entries, sizeof(entries));
+    fileClose(file);
+
+    if (!inPlace) {
+        // SPIFFS does not rename over an existing file
+        if (fileExist(APP_SETTINGS_BINARY_FILE))
+            fileDelete(APP_SETTINGS_BINARY_FILE);
+        if (fileRename(APP_SETTINGS_BINARY_TEMP_FILE, APP_SETTINGS_BINARY_FILE) < 0) {
+            debug_e("SettingsStore::save: cannot rename %s", APP_SETTINGS_BINARY_TEMP_FILE);
+            return false;
+        }
+    }
+
+    debug_i("SettingsStore::save: %d of %d sections written%s", numWritten, numSections, inPlace ? " in place" : "");
+    return true;
+}
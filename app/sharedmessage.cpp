@@ -0,0 +1,39 @@
+#include <RGBWWCtrl.h>
+
+SharedMessage::SharedMessage(size_t length, Kind kind) : _length(length), _kind(kind) {
+    _pData = new char[length + 1];
+}
+
+SharedMessage::~SharedMessage() {
+    delete[] _pData;
+}
+
+SharedMessage* SharedMessage::create(const char* pData, size_t length, Kind kind) {
+    SharedMessage* pMsg = new SharedMessage(length, kind);
+    memcpy(pMsg->_pData, pData, length);
+    pMsg->_pData[length] = '\0';
+    return pMsg;
+}
+
+SharedMessage* SharedMessage::create(const JsonObject& json, Kind kind) {
+    const size_t length = json.measureLength();
+    SharedMessage* pMsg = new SharedMessage(length, kind);
+    json.printTo(pMsg->_pData, length + 1);
+    return pMsg;
+}
+
+SharedMessage* SharedMessage::createBuffer(size_t capacity, Kind kind) {
+    SharedMessage* pMsg = new SharedMessage(capacity, kind);
+    pMsg->setLength(0);
+    return pMsg;
+}
+
+void SharedMessage::setLength(size_t length) {
+    _length = length;
+    _pData[length] = '\0';
+}
+
+void SharedMessage::release() {
+    if (--_refCount == 0)
+        delete this;
+}
@@ -0,0 +1,55 @@
+#include <RGBWWCtrl.h>
+
+namespace {
+    inline uint64_t rotl(uint64_t x, int b) {
+        return (x << b) | (x >> (64 - b));
+    }
+
+    inline uint64_t readLE64(const uint8_t* p) {
+        uint64_t value = 0;
+        for (int i=7; i >= 0; --i)
+            value = (value << 8) | p[i];
+        return value;
+    }
+
+    inline void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    }
+}
+
+uint64_t siphash24(const uint8_t key[16], const void* pData, size_t length) {
+    const uint64_t k0 = readLE64(key);
+    const uint64_t k1 = readLE64(key + 8);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+
+    const uint8_t* p = static_cast<const uint8_t*>(pData);
+    const uint8_t* const pEnd = p + (length & ~static_cast<size_t>(7));
+    for (; p != pEnd; p += 8) {
+        const uint64_t m = readLE64(p);
+        v3 ^= m;
+        sipRound(v0, v1, v2, v3);
+        sipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    // the last 0..7 bytes and the length in the top byte
+    uint64_t b = static_cast<uint64_t>(length) << 56;
+    for (int i=(length & 7) - 1; i >= 0; --i)
+        b |= static_cast<uint64_t>(p[i]) << (8 * i);
+
+    v3 ^= b;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    for (int i=0; i < 4; ++i)
+        sipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -4,6 +4,10 @@
 StepSync::~StepSync() {
 };
 
+uint32_t StepSync::onMasterClockTimed(uint32_t stepsCurrent, uint32_t stepsMaster, float masterAhead) {
+    return onMasterClock(stepsCurrent, stepsMaster + lroundf(masterAhead));
+}
+
 uint32_t ClockCatchUp::reset() {
     _firstMasterSync = true;
     _catchupOffset = 0;
@@ -39,3 +43,108 @@ int ClockCatchUp::getCatchupOffset() const {
     return _catchupOffset;
 }
 
+
+uint32_t ClockPIServo::reset() {
+    _firstMasterSync = true;
+    _catchupOffset = 0;
+    _offset = 0;
+    _integral = 0;
+    _correction = 0;
+    _driftRate = 0;
+    _jitter = 0;
+    _numAccepted = 0;
+    _numRejected = 0;
+    _numConsecutiveRejects = 0;
+    _interval = _constBaseInt;
+    return _interval;
+}
+
+uint32_t ClockPIServo::onMasterClock(uint32_t stepsCurrent, uint32_t stepsMaster) {
+    return update(stepsCurrent, stepsMaster, 0);
+}
+
+uint32_t ClockPIServo::onMasterClockTimed(uint32_t stepsCurrent, uint32_t stepsMaster, float masterAhead) {
+    return update(stepsCurrent, stepsMaster, masterAhead);
+}
+
+uint32_t ClockPIServo::update(uint32_t stepsCurrent, uint32_t stepsMaster, float masterAhead) {
+    if (_firstMasterSync) {
+        _stepsSyncMasterLast = stepsMaster;
+        _stepsSyncLast = stepsCurrent;
+        _masterAheadLast = masterAhead;
+        _firstMasterSync = false;
+        return _interval;
+    }
+
+    int diff = StepSync::calcOverflowVal(_stepsSyncLast, stepsCurrent);
+    int masterDiff = StepSync::calcOverflowVal(_stepsSyncMasterLast, stepsMaster);
+    if (masterDiff <= 0)
+        return _interval;
+
+    const float curOffset = masterDiff - diff + (masterAhead - _masterAheadLast);
+    // a positive correction shortens the interval: the slave gains on the master
+    const float predicted = (_driftRate - _correction) * masterDiff;
+    const float deviation = curOffset - predicted;
+
+    // a message held back by the broker shows up as a sudden negative offset.
+    // Ignore it and keep the last good sync point as reference for the next one.
+    // Several outliers in a row are a real change and are accepted
+    if (_numAccepted >= _minSamplesForRejection && _numConsecutiveRejects < _maxConsecutiveRejects
+            && fabs(deviation) > _outlierFactor * _jitter + _outlierMinSteps) {
+        ++_numRejected;
+        ++_numConsecutiveRejects;
+        debug_d("ClockPIServo: rejected offset %f (predicted: %f | jitter: %f)\n", curOffset, predicted, _jitter);
+        return _interval;
+    }
+    _numConsecutiveRejects = 0;
+    ++_numAccepted;
+
+    _driftRate += deviation * _jitterGain / masterDiff;
+    _jitter += (fabs(deviation) - _jitter) * _jitterGain;
+
+    _offset += curOffset;
+    _catchupOffset = lroundf(_offset);
+    _integral += _offset;
+
+    // anti windup: the I part only has to cover the crystal drift
+    const float maxIntegral = _maxIntegralCorrection * masterDiff / _ki;
+    _integral = std::min(std::max(_integral, -maxIntegral), maxIntegral);
+
+    const float maxCorrection = _maxCorrection;
+    _correction = (_kp * _offset + _ki * _integral) / masterDiff;
+    _correction = std::min(std::max(_correction, -maxCorrection), maxCorrection);
+    _interval = _constBaseInt * (1.0f - _correction);
+    debug_d("ClockPIServo: CurOffset: %f | Catchup Offset: %f | Integral: %f | Jitter: %f | New Int: %d\n",
+            curOffset, _offset, _integral, _jitter, _interval);
+
+    _stepsSyncMasterLast = stepsMaster;
+    _stepsSyncLast = stepsCurrent;
+    _masterAheadLast = masterAhead;
+
+    return _interval;
+}
+
+int ClockPIServo::getCatchupOffset() const {
+    return _catchupOffset;
+}
+
+
+uint32_t ClockTransitFilter::onMessage(uint32_t sentUs, uint32_t receivedUs) {
+    const uint32_t transit = receivedUs - sentUs;
+    _transits[_next] = transit;
+    _next = (_next + 1) % _window;
+    if (_numTransits < _window)
+        ++_numTransits;
+
+    // compare as differences: the clock offset makes the absolute values arbitrary
+    int32_t maxExcess = 0;
+    for (int i=0; i < _numTransits; ++i) {
+        maxExcess = std::max(maxExcess, static_cast<int32_t>(transit - _transits[i]));
+    }
+    return maxExcess;
+}
+
+void ClockTransitFilter::reset() {
+    _numTransits = 0;
+    _next = 0;
+}
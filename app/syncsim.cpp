@@ -0,0 +1,155 @@
+#include <RGBWWCtrl.h>
+
+#ifdef ENABLE_BENCHMARK
+
+namespace {
+    // xorshift32, deterministic across runs for a given seed
+    class Random {
+    public:
+        Random(uint32_t seed) : _state(seed ? seed : 1) {}
+
+        // uniform in [0, 1)
+        double next() {
+            _state ^= _state << 13;
+            _state ^= _state >> 17;
+            _state ^= _state << 5;
+            return _state / 4294967296.0;
+        }
+
+    private:
+        uint32_t _state;
+    };
+
+    struct SlaveState {
+        StepSync* pSync;
+        double drift;
+        uint32_t interval;
+        double steps;
+        uint64_t time;
+        double offsetRef;
+        bool hasRef;
+        ClockTransitFilter transitFilter;
+    };
+
+    uint32_t getDelayMs(const SyncSimulator::Config& cfg, Random& random, int k, int slave) {
+        switch (cfg.delayModel) {
+        case SyncSimulator::DelayModel::Profile:
+            // shifted per slave, otherwise all slaves see the same delays at the same time
+            return cfg.numDelays > 0 ? cfg.pDelaysMs[(k + slave * 7) % cfg.numDelays] : 0;
+        case SyncSimulator::DelayModel::Uniform:
+            return cfg.delayMinMs + random.next() * 2 * cfg.delayMeanMs;
+        case SyncSimulator::DelayModel::Exponential:
+            return cfg.delayMinMs - cfg.delayMeanMs * log(1.0 - random.next());
+        }
+        return 0;
+    }
+}
+
+SyncSimulator::Result SyncSimulator::run(StepSync& sync, const Config& cfg) {
+    StepSync* slaves[] = {&sync};
+    Config single = cfg;
+    single.numSlaves = 1;
+    return run(slaves, single);
+}
+
+SyncSimulator::Result SyncSimulator::run(StepSync* const* ppSlaves, const Config& cfg, TraceDelegate trace) {
+    Result result;
+
+    const uint32_t baseInterval = RGBWW_MINTIMEDIFF_US;
+    const uint32_t minInterval = RGBWW_MINTIMEDIFF_US / 2;
+    const uint32_t maxInterval = RGBWW_MINTIMEDIFF_US * 3 / 2;
+    const uint64_t stepsPerSync = cfg.masterIntervalS * RGBWW_UPDATEFREQUENCY;
+    const int numSyncs = cfg.durationS / cfg.masterIntervalS;
+    const int numSlaves = std::min(std::max(cfg.numSlaves, 1), static_cast<int>(maxSlaves));
+    // arbitrary offset between the master and slave clocks
+    const uint32_t slaveClockOffsetUs = 123456789;
+
+    Random random(cfg.seed);
+    SlaveState slaves[maxSlaves];
+    for (int i=0; i < numSlaves; ++i) {
+        SlaveState& s = slaves[i];
+        const int driftPpm = (numSlaves > 1) ? cfg.driftPpm - cfg.driftSpreadPpm + 2 * cfg.driftSpreadPpm * i / (numSlaves - 1) : cfg.driftPpm;
+        s.pSync = ppSlaves[i];
+        s.drift = 1.0 + driftPpm / 1000000.0;
+        s.interval = s.pSync->reset();
+        // slaves start at different points within a step
+        s.steps = static_cast<double>(i) / numSlaves;
+        s.time = 0;
+        s.offsetRef = 0;
+        s.hasRef = false;
+    }
+
+    int lastOutOfRange = 0;
+    int numSteady = 0;
+    double sumSteady = 0;
+    float offsets[maxSlaves];
+
+    for (int k=1; k <= numSyncs; ++k) {
+        // master publishes on exact step boundaries, each slave sees it after its broker delay
+        const uint64_t masterSteps = k * stepsPerSync;
+        const uint64_t sendTime = masterSteps * baseInterval;
+        const bool steady = k > numSyncs / 2;
+        float minOffset = 0;
+        float maxOffset = 0;
+
+        for (int i=0; i < numSlaves; ++i) {
+            SlaveState& s = slaves[i];
+            const uint64_t arrivalTime = sendTime + getDelayMs(cfg, random, k - 1, i) * 1000ull;
+
+            s.steps += double(arrivalTime - s.time) / (s.interval * s.drift);
+            s.time = arrivalTime;
+
+            if (cfg.lossPercent > 0 && random.next() * 100 < cfg.lossPercent) {
+                ++result.numLost;
+            }
+            else {
+                if (cfg.timestamps) {
+                    // system_get_time() of the slave runs on the same drifting crystal
+                    const uint32_t receivedUs = static_cast<uint64_t>(arrivalTime / s.drift) + slaveClockOffsetUs;
+                    const uint32_t delayUs = s.transitFilter.onMessage(sendTime, receivedUs);
+                    const double localPhaseUs = (s.steps - floor(s.steps)) * s.interval * s.drift;
+                    const float masterAhead = (delayUs - localPhaseUs) / baseInterval;
+                    s.interval = s.pSync->onMasterClockTimed(static_cast<uint32_t>(s.steps), static_cast<uint32_t>(masterSteps), masterAhead);
+                }
+                else {
+                    s.interval = s.pSync->onMasterClock(static_cast<uint32_t>(s.steps), static_cast<uint32_t>(masterSteps));
+                }
+                s.interval = std::min(std::max(s.interval, minInterval), maxInterval);
+            }
+
+            // true phase error, relative to the first sync like the StepSync offsets
+            const double offset = double(arrivalTime) / baseInterval - s.steps;
+            if (!s.hasRef) {
+                s.offsetRef = offset;
+                s.hasRef = true;
+            }
+            offsets[i] = offset - s.offsetRef;
+            const double absOffset = fabs(offsets[i]);
+
+            if (absOffset > 1.0)
+                lastOutOfRange = k;
+
+            if (steady) {
+                ++numSteady;
+                sumSteady += absOffset;
+                result.maxAbsOffset = std::max(result.maxAbsOffset, static_cast<float>(absOffset));
+            }
+
+            minOffset = (i == 0) ? offsets[i] : std::min(minOffset, offsets[i]);
+            maxOffset = (i == 0) ? offsets[i] : std::max(maxOffset, offsets[i]);
+        }
+
+        if (steady)
+            result.maxSpread = std::max(result.maxSpread, maxOffset - minOffset);
+
+        if (trace)
+            trace(k * cfg.masterIntervalS, offsets, numSlaves);
+    }
+
+    result.numSyncs = numSyncs;
+    result.convergenceS = lastOutOfRange * cfg.masterIntervalS;
+    result.meanAbsOffset = numSteady > 0 ? sumSteady / numSteady : 0;
+    return result;
+}
+
+#endif // ENABLE_BENCHMARK
@@ -0,0 +1,165 @@
+#include <RGBWWCtrl.h>
+
+TickProfiler::~TickProfiler() {
+    stop();
+}
+
+void TickProfiler::start(uint32_t numTicks, bool sweep) {
+    stop();
+
+    const uint32_t limit = maxTicks;
+    _numTicks = std::min(std::max(numTicks, static_cast<uint32_t>(1)), limit);
+    debug_i("TickProfiler::start: profiling %u ticks%s", _numTicks, sweep ? " per combination" : "");
+
+    _pHistograms = new Histogram[PhaseCount];
+    if (sweep) {
+        const ApplicationSettings& cfg = app.cfg;
+        _savedCombination = (cfg.sync.clock_master_enabled ? 1 : 0) | (cfg.sync.color_master_enabled ? 2 : 0)
+                | (cfg.events.server_enabled ? 4 : 0);
+        _combination = 0;
+        applyCombination(_combination);
+    }
+    beginRun();
+}
+
+void TickProfiler::stop() {
+    _reportTimer.stop();
+    if (_combination >= 0)
+        applyCombination(_savedCombination);
+    _combination = -1;
+
+    delete[] _pHistograms;
+    _pHistograms = nullptr;
+    _remainingTicks = 0;
+}
+
+void TickProfiler::beginRun() {
+    for (int i=0; i < PhaseCount; ++i)
+        _pHistograms[i] = Histogram();
+    _remainingTicks = _numTicks;
+}
+
+void TickProfiler::endTick() {
+    if (!isActive())
+        return;
+
+    _pHistograms[PhaseTotal].add(getCycleCount() - _tickStart);
+
+    // printing takes longer than a tick, so it does not run in the LED timer
+    if (--_remainingTicks == 0)
+        _reportTimer.initializeMs(1, TimerDelegate(&TickProfiler::onReportTimer, this)).startOnce();
+}
+
+void TickProfiler::onReportTimer() {
+    printReport();
+
+    if (_combination >= 0 && ++_combination < numCombinations) {
+        applyCombination(_combination);
+        beginRun();
+        return;
+    }
+    stop();
+}
+
+void TickProfiler::applyCombination(int combination) {
+    app.cfg.sync.clock_master_enabled = combination & 1;
+    app.cfg.sync.color_master_enabled = combination & 2;
+    app.cfg.events.server_enabled = combination & 4;
+}
+
+void TickProfiler::printReport() const {
+    const uint32_t mhz = system_get_cpu_freq();
+
+    if (_combination >= 0)
+        Serial.printf("TickProfiler: combination %d of %d\n", _combination + 1, numCombinations);
+    Serial.printf("TickProfiler: %u ticks @ %u MHz | interval: %d us\n", _pHistograms[PhaseTotal].count, mhz, RGBWW_MINTIMEDIFF_US);
+    Serial.printf("  sync: clock_master: %d | color_master: %d (%d ms) | cmd_master: %d | mqtt running: %d\n",
+            app.cfg.sync.clock_master_enabled, app.cfg.sync.color_master_enabled, app.cfg.sync.color_master_interval_ms,
+            app.cfg.sync.cmd_master_enabled, app.mqttclient.isRunning());
+    Serial.printf("  events: server: %d | color_interval: %d ms | color_mininterval: %d ms | transfin_interval: %d ms | clients: %d\n",
+            app.cfg.events.server_enabled, app.cfg.events.color_interval_ms, app.cfg.events.color_mininterval_ms,
+            app.cfg.events.transfin_interval_ms, app.eventserver.activeClients);
+    Serial.printf("  %-14s %10s %10s %10s %10s %10s | %8s %8s %8s\n", "phase", "mean", "p50", "p90", "p99", "max", "p50_us", "p99_us", "max_us");
+
+    for (int i=0; i < PhaseCount; ++i) {
+        const Histogram& h = _pHistograms[i];
+        const uint32_t mean = h.count > 0 ? static_cast<uint32_t>(h.sum / h.count) : 0;
+        const uint32_t p50 = h.getPercentile(500);
+        const uint32_t p90 = h.getPercentile(900);
+        const uint32_t p99 = h.getPercentile(990);
+        Serial.printf("  %-14s %10u %10u %10u %10u %10u | %8u %8u %8u\n", getPhaseName(static_cast<Phase>(i)),
+                mean, p50, p90, p99, h.maxValue, p50 / mhz, p99 / mhz, h.maxValue / mhz);
+    }
+}
+
+const char* TickProfiler::getPhaseName(Phase phase) {
+    switch (phase) {
+    case PhaseScheduled:
+        return "scheduled";
+    case PhaseShow:
+        return "show";
+    case PhaseClockMaster:
+        return "clock_master";
+    case PhaseEvents:
+        return "events";
+    case PhaseMqtt:
+        return "mqtt_color";
+    case PhaseStableColor:
+        return "stable_color";
+    case PhaseTransFinished:
+        return "transfin";
+    case PhaseTotal:
+        return "total";
+    default:
+        return "unknown";
+    }
+}
+
+////////////////////////////////////////
+
+int TickProfiler::Histogram::getBucket(uint32_t value) {
+    if (value < (1u << subBucketBits))
+        return value;
+
+    const int msb = 31 - __builtin_clz(value);
+    const int sub = (value >> (msb - subBucketBits)) & ((1 << subBucketBits) - 1);
+    return ((msb - subBucketBits + 1) << subBucketBits) + sub;
+}
+
+uint32_t TickProfiler::Histogram::getBucketLowerBound(int bucket) {
+    if (bucket < (1 << subBucketBits))
+        return bucket;
+
+    const int msb = (bucket >> subBucketBits) + subBucketBits - 1;
+    if (msb > 31)
+        return std::numeric_limits<uint32_t>::max();
+
+    const int sub = bucket & ((1 << subBucketBits) - 1);
+    return (1u << msb) | (static_cast<uint32_t>(sub) << (msb - subBucketBits));
+}
+
+void TickProfiler::Histogram::add(uint32_t value) {
+    const int bucket = getBucket(value);
+    if (buckets[bucket] < std::numeric_limits<uint16_t>::max())
+        ++buckets[bucket];
+    ++count;
+    sum += value;
+    maxValue = std::max(maxValue, value);
+}
+
+uint32_t TickProfiler::Histogram::getPercentile(uint32_t permille) const {
+    if (count == 0)
+        return 0;
+
+    const uint32_t rank = (static_cast<uint64_t>(count) * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (int i=0; i < numBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // report the upper bound of the bucket but never more than the real maximum
+            const uint32_t upper = (i + 1 < numBuckets) ? getBucketLowerBound(i + 1) - 1 : maxValue;
+            return std::min(upper, maxValue);
+        }
+    }
+    return maxValue;
+}
@@ -0,0 +1,37 @@
+#include <RGBWWCtrl.h>
+
+bool TickScheduler::addTask(const int* pIntervalMs, TaskDelegate callback, TickProfiler::Phase phase, bool runOnAnimFinished) {
+    if (_numTasks >= maxTasks) {
+        debug_e("TickScheduler::addTask: too many tasks");
+        return false;
+    }
+
+    Task& task = _tasks[_numTasks++];
+    task.pIntervalMs = pIntervalMs;
+    task.callback = callback;
+    task.phase = phase;
+    task.runOnAnimFinished = runOnAnimFinished;
+    task.dueMs = millis();
+    return true;
+}
+
+void TickScheduler::run(uint32_t nowMs, bool animFinished, TickProfiler& profiler) {
+    for (int i=0; i < _numTasks; ++i) {
+        Task& task = _tasks[i];
+        const int intervalMs = *task.pIntervalMs;
+        if (intervalMs >= 0) {
+            const bool due = static_cast<int32_t>(nowMs - task.dueMs) >= 0;
+            if (due && intervalMs > 0) {
+                task.dueMs += intervalMs;
+                // stalled for more than an interval or the interval was shortened:
+                // start over from now instead of running several times in a row
+                if (static_cast<int32_t>(nowMs - task.dueMs) >= 0 || task.dueMs - nowMs > static_cast<uint32_t>(intervalMs))
+                    task.dueMs = nowMs + intervalMs;
+            }
+
+            if (due || intervalMs == 0 || (animFinished && task.runOnAnimFinished))
+                task.callback();
+        }
+        profiler.endPhase(task.phase);
+    }
+}
@@ -0,0 +1,90 @@
+#include <RGBWWCtrl.h>
+#include <algorithm>
+
+const uint32_t TickStats::_bucketLimitsUs[numBuckets - 1] = {100, 250, 500, 1000, 2000, 5000, 10000};
+
+void TickStats::onTickEnd(uint32_t nowUs, uint32_t intervalUs) {
+    const uint32_t execUs = nowUs - _tickStartUs;
+    // ticks firing too early are counted as being on time
+    const uint32_t latenessUs = static_cast<uint32_t>(std::max(_lateness, static_cast<int32_t>(0)));
+
+    _latenessRing[_ringPos] = std::min(latenessUs, static_cast<uint32_t>(UINT16_MAX));
+    _execRing[_ringPos] = std::min(execUs, static_cast<uint32_t>(UINT16_MAX));
+    _ringPos = (_ringPos + 1) % numSamples;
+    _ringCount = std::min(_ringCount + 1, static_cast<int>(numSamples));
+
+    ++_latenessHist[getBucket(latenessUs)];
+    ++_execHist[getBucket(execUs)];
+
+    ++_numTicks;
+    if (execUs > intervalUs)
+        ++_numOverruns;
+
+    _maxLatenessUs = std::max(_maxLatenessUs, latenessUs);
+    _maxExecUs = std::max(_maxExecUs, execUs);
+}
+
+void TickStats::onStall(uint32_t stallUs) {
+    ++_numStalls;
+    _maxStallUs = std::max(_maxStallUs, stallUs);
+}
+
+void TickStats::reset() {
+    _ringPos = 0;
+    _ringCount = 0;
+    for (int i=0; i < numBuckets; ++i) {
+        _latenessHist[i] = 0;
+        _execHist[i] = 0;
+    }
+    _numTicks = 0;
+    _numOverruns = 0;
+    _maxLatenessUs = 0;
+    _maxExecUs = 0;
+    _numStalls = 0;
+    _maxStallUs = 0;
+}
+
+int TickStats::getBucket(uint32_t us) {
+    for (int i=0; i < numBuckets - 1; ++i) {
+        if (us < _bucketLimitsUs[i])
+            return i;
+    }
+    return numBuckets - 1;
+}
+
+uint16_t TickStats::getPercentile(const uint16_t* pRing, int count, int percent) {
+    if (count == 0)
+        return 0;
+
+    uint16_t sorted[numSamples];
+    std::copy(pRing, pRing + count, sorted);
+    std::sort(sorted, sorted + count);
+    return sorted[((count - 1) * percent) / 100];
+}
+
+void TickStats::fillJson(JsonObject& json) const {
+    json["ticks"] = _numTicks;
+    json["overruns"] = _numOverruns;
+    json["stalls"] = _numStalls;
+    json["max_stall_us"] = _maxStallUs;
+
+    JsonObject& late = json.createNestedObject("lateness_us");
+    late["p50"] = getPercentile(_latenessRing, _ringCount, 50);
+    late["p99"] = getPercentile(_latenessRing, _ringCount, 99);
+    late["max"] = _maxLatenessUs;
+    JsonArray& lateHist = late.createNestedArray("hist");
+    for (int i=0; i < numBuckets; ++i)
+        lateHist.add(_latenessHist[i]);
+
+    JsonObject& exec = json.createNestedObject("exec_us");
+    exec["p50"] = getPercentile(_execRing, _ringCount, 50);
+    exec["p99"] = getPercentile(_execRing, _ringCount, 99);
+    exec["max"] = _maxExecUs;
+    JsonArray& execHist = exec.createNestedArray("hist");
+    for (int i=0; i < numBuckets; ++i)
+        execHist.add(_execHist[i]);
+
+    JsonArray& limits = json.createNestedArray("hist_limits_us");
+    for (int i=0; i < numBuckets - 1; ++i)
+        limits.add(_bucketLimitsUs[i]);
+}
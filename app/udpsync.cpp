@@ -0,0 +1,247 @@
+#include <RGBWWCtrl.h>
+#include <lwip/igmp.h>
+
+UdpSync::~UdpSync() {
+    stop();
+}
+
+void UdpSync::start() {
+    stop();
+
+    if (!parseKey(app.cfg.sync.udp_key, _key)) {
+        debug_e("UdpSync::start: sync.udp_key must be 32 hex digits");
+        return;
+    }
+
+    _group = IPAddress(app.cfg.sync.udp_group);
+    _port = app.cfg.sync.udp_port;
+    _senderId = system_get_chip_id();
+    _session = os_random();
+    _nextSeq = 0;
+    _firstClock = true;
+    for (int i=0; i < _maxSenders; ++i)
+        _senders[i] = SenderState();
+
+    ip_addr_t group;
+    group.addr = static_cast<uint32_t>(_group);
+    if (igmp_joingroup(IP_ADDR_ANY, &group) != ERR_OK) {
+        debug_e("UdpSync::start: joining %s failed", _group.toString().c_str());
+        return;
+    }
+
+    _pUdp = new UdpConnection(UdpConnectionDataDelegate(&UdpSync::onReceive, this));
+    if (!_pUdp->listen(_port)) {
+        debug_e("UdpSync::start: listen on port %d failed", _port);
+        stop();
+        return;
+    }
+    debug_i("UdpSync::start: group %s:%d", _group.toString().c_str(), _port);
+}
+
+void UdpSync::stop() {
+    if (_pUdp == nullptr)
+        return;
+
+    delete _pUdp;
+    _pUdp = nullptr;
+
+    ip_addr_t group;
+    group.addr = static_cast<uint32_t>(_group);
+    igmp_leavegroup(IP_ADDR_ANY, &group);
+}
+
+void UdpSync::sendClock(uint32_t steps, uint32_t phaseUs) {
+    if (_firstClock) {
+        // slaves restart their step sync, like "reset" on the MQTT clock topic
+        send(Type::ClockReset, nullptr, 0);
+        _firstClock = false;
+        return;
+    }
+
+    ClockPayload payload;
+    payload.steps = steps;
+    payload.timestampUs = system_get_time();
+    payload.phaseUs = phaseUs;
+    send(Type::Clock, reinterpret_cast<const char*>(&payload), sizeof(payload));
+}
+
+void UdpSync::sendCommand(const String& payload) {
+    send(Type::Command, payload.c_str(), payload.length(), _commandCopies);
+}
+
+void UdpSync::sendColor(const String& payload) {
+    send(Type::Color, payload.c_str(), payload.length());
+}
+
+void UdpSync::send(Type type, const char* pPayload, size_t length, int copies) {
+    if (_pUdp == nullptr)
+        return;
+
+    if (sizeof(Header) + length > _maxDatagramSize) {
+        debug_w("UdpSync::send: payload too big (%d bytes)", length);
+        return;
+    }
+
+    // clock and color datagrams fit on the stack, only commands may need the heap
+    char stackBuf[_stackBufferSize];
+    const size_t size = sizeof(Header) + length;
+    char* buf = (size <= sizeof(stackBuf)) ? stackBuf : new char[size];
+
+    Header* pHeader = reinterpret_cast<Header*>(buf);
+    pHeader->headerMarker = Header::marker;
+    pHeader->headerVersion = Header::version;
+    pHeader->type = static_cast<uint8_t>(type);
+    pHeader->reserved = 0;
+    pHeader->senderId = _senderId;
+    pHeader->session = _session;
+    pHeader->seq = _nextSeq++;
+    if (length > 0)
+        memcpy(buf + sizeof(Header), pPayload, length);
+    getMac(buf, size, pHeader->mac);
+
+    // copies carry the same sequence number, receivers drop the duplicates
+    for (int i=0; i < copies; ++i)
+        _pUdp->sendTo(_group, _port, buf, size);
+
+    if (buf != stackBuf)
+        delete[] buf;
+}
+
+void UdpSync::onReceive(UdpConnection& connection, char* data, int size, IPAddress remoteIP, uint16_t remotePort) {
+    const uint32_t receivedUs = system_get_time();
+    if (size < static_cast<int>(sizeof(Header)))
+        return;
+
+    Header header;
+    memcpy(&header, data, sizeof(header));
+    if (header.headerMarker != Header::marker || header.headerVersion != Header::version || header.senderId == _senderId)
+        return;
+
+    // compare all bytes, the time taken must not tell how many matched
+    uint8_t mac[sizeof(header.mac)];
+    getMac(data, size, mac);
+    uint8_t diff = 0;
+    for (unsigned i=0; i < sizeof(mac); ++i)
+        diff |= mac[i] ^ header.mac[i];
+    if (diff != 0) {
+        ++_numRejected;
+        return;
+    }
+
+    const Type type = static_cast<Type>(header.type);
+    if (!acceptSeq(header, type != Type::Command)) {
+        ++_numDropped;
+        return;
+    }
+    ++_numReceived;
+
+    dispatch(type, data + sizeof(Header), size - sizeof(Header), receivedUs);
+}
+
+void UdpSync::dispatch(Type type, const char* pPayload, size_t length, uint32_t receivedUs) {
+    switch (type) {
+    case Type::Clock:
+        if (app.cfg.sync.clock_slave_enabled && length >= sizeof(ClockPayload)) {
+            ClockPayload payload;
+            memcpy(&payload, pPayload, sizeof(payload));
+            app.rgbwwctrl.onMasterClock(payload.steps, payload.timestampUs, payload.phaseUs, receivedUs);
+        }
+        break;
+
+    case Type::ClockReset:
+        if (app.cfg.sync.clock_slave_enabled)
+            app.rgbwwctrl.onMasterClockReset();
+        break;
+
+    case Type::Command:
+        if (app.cfg.sync.cmd_slave_enabled) {
+            String msg;
+            msg.concat(pPayload, length);
+            app.jsonproc.onRelayedCommand(msg);
+        }
+        break;
+
+    case Type::Color:
+        if (app.cfg.sync.color_slave_enabled) {
+            String error;
+            app.jsonproc.onColor(pPayload, length, error, false);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void UdpSync::getMac(char* pData, size_t size, uint8_t* pMac) const {
+    memset(pData + offsetof(Header, mac), 0, sizeof(Header::mac));
+    const uint64_t mac = siphash24(_key, pData, size);
+    memcpy(pMac, &mac, sizeof(Header::mac));
+}
+
+bool UdpSync::parseKey(const String& hex, uint8_t* pKey) {
+    if (hex.length() != 2 * sizeof(_key))
+        return false;
+
+    for (unsigned i=0; i < hex.length(); ++i) {
+        const char c = hex[i];
+        int nibble;
+        if (c >= '0' && c <= '9')
+            nibble = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            nibble = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            nibble = c - 'A' + 10;
+        else
+            return false;
+        pKey[i / 2] = (i % 2 == 0) ? nibble << 4 : pKey[i / 2] | nibble;
+    }
+    return true;
+}
+
+UdpSync::SenderState& UdpSync::getSender(const Header& header) {
+    int oldest = 0;
+    for (int i=0; i < _maxSenders; ++i) {
+        if (_senders[i].senderId == header.senderId)
+            return _senders[i];
+        if (_senders[i].lastUsedMs < _senders[oldest].lastUsedMs)
+            oldest = i;
+    }
+
+    SenderState& sender = _senders[oldest];
+    sender = SenderState();
+    sender.senderId = header.senderId;
+    return sender;
+}
+
+bool UdpSync::acceptSeq(const Header& header, bool newestOnly) {
+    SenderState& sender = getSender(header);
+    sender.lastUsedMs = millis();
+
+    if (sender.session != header.session || sender.seenMask == 0) {
+        // new sender or the sender rebooted
+        sender.session = header.session;
+        sender.highestSeq = header.seq;
+        sender.seenMask = 1;
+        return true;
+    }
+
+    const int32_t ahead = header.seq - sender.highestSeq;
+    if (ahead > 0) {
+        _numLost += ahead - 1;
+        sender.seenMask = (ahead < 32) ? (sender.seenMask << ahead) | 1 : 1;
+        sender.highestSeq = header.seq;
+        return true;
+    }
+
+    // duplicate or reordered datagram
+    const uint32_t behind = -ahead;
+    if (newestOnly || behind >= 32 || (sender.seenMask & (1u << behind)))
+        return false;
+
+    // a datagram counted as lost arrived late
+    sender.seenMask |= 1u << behind;
+    if (_numLost > 0)
+        --_numLost;
+    return true;
+}
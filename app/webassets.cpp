@@ -0,0 +1,93 @@
+#include <RGBWWCtrl.h>
+
+void WebAssets::build() {
+    clear();
+
+    Vector<String> files = fileList();
+    for (unsigned i=0; i < files.count(); ++i) {
+        const String& fileName = files[i];
+        // settings and other internal files are never served
+        if (fileName.length() == 0 || fileName[0] == '.')
+            continue;
+
+        Asset asset;
+        asset.gzip = fileName.endsWith(".gz");
+        asset.name = asset.gzip ? fileName.substring(0, fileName.length() - 3) : fileName;
+        asset.size = fileGetSize(fileName);
+
+        // the compressed file wins, like in HttpResponse::sendFile()
+        Asset* pExisting = find(asset.name);
+        if (pExisting != nullptr) {
+            if (asset.gzip)
+                *pExisting = asset;
+            continue;
+        }
+        _assets.add(asset);
+    }
+    debug_i("WebAssets::build: %d assets", _assets.count());
+
+    _hashIndex = 0;
+    _hashTimer.initializeMs(_hashIntervalMs, TimerDelegate(&WebAssets::hashNextChunk, this)).start();
+}
+
+void WebAssets::clear() {
+    stopHashing();
+    _assets.clear();
+}
+
+void WebAssets::stopHashing() {
+    _hashTimer.stop();
+    if (_hashFile >= 0) {
+        fileClose(_hashFile);
+        _hashFile = -1;
+    }
+}
+
+WebAssets::Asset* WebAssets::find(const String& name) {
+    for (unsigned i=0; i < _assets.count(); ++i) {
+        if (_assets[i].name == name)
+            return &_assets[i];
+    }
+    return nullptr;
+}
+
+String WebAssets::getETag(const Asset& asset) const {
+    if (!asset.hashed)
+        return String();
+
+    return "\"" + String(asset.hash, HEX) + "\"";
+}
+
+void WebAssets::hashNextChunk() {
+    if (_hashFile < 0) {
+        if (_hashIndex >= _assets.count()) {
+            debug_i("WebAssets: %d assets hashed", _assets.count());
+            stopHashing();
+            return;
+        }
+
+        _hashFile = fileOpen(_assets[_hashIndex].getFileName(), eFO_ReadOnly);
+        if (_hashFile < 0) {
+            // served without ETag
+            ++_hashIndex;
+            return;
+        }
+        // FNV-1a
+        _hash = 2166136261u;
+    }
+
+    uint8_t buf[_hashChunkSize];
+    const int length = fileRead(_hashFile, buf, sizeof(buf));
+    for (int i=0; i < length; ++i) {
+        _hash ^= buf[i];
+        _hash *= 16777619u;
+    }
+
+    if (length < _hashChunkSize) {
+        fileClose(_hashFile);
+        _hashFile = -1;
+        Asset& asset = _assets[_hashIndex++];
+        asset.hash = _hash;
+        asset.hashed = length >= 0;
+    }
+}
@@ -22,7 +22,49 @@
 #include <RGBWWCtrl.h>
 #include <Services/WebHelpers/base64.h>
 
+namespace {
+    // constant responses, sent from flash
+    const char successJson[] PROGMEM = "{\"success\":true}";
+    const char badRequestJson[] PROGMEM = "{\"error\":\"bad request\"}";
+    const char missingParamJson[] PROGMEM = "{\"error\":\"missing param\"}";
+    const char unauthorizedJson[] PROGMEM = "{\"error\":\"authorization required\"}";
+    const char updateInProgressJson[] PROGMEM = "{\"error\":\"update in progress\"}";
+    const char pingJson[] PROGMEM = "{\"ping\":\"pong\"}";
+}
+
+const ApplicationWebserver::Route ApplicationWebserver::_routes[] = {
+    // most frequent first, the table is searched from the top
+    { "/color", MethodGet, RouteAuth | RouteBlockOta, _minimumHeap, &ApplicationWebserver::onColorGet },
+    { "/color", MethodPost, RouteAuth | RouteBlockOta, 0, &ApplicationWebserver::onColorPost },
+    { "/info", MethodGet, RouteAuth | RouteBlockOta, _minimumHeap, &ApplicationWebserver::onInfo },
+    { "/ping", MethodGet, 0, 0, &ApplicationWebserver::onPing },
+    { "/stop", MethodPost, 0, 0, &ApplicationWebserver::onStop },
+    { "/skip", MethodPost, 0, 0, &ApplicationWebserver::onSkip },
+    { "/pause", MethodPost, 0, 0, &ApplicationWebserver::onPause },
+    { "/continue", MethodPost, 0, 0, &ApplicationWebserver::onContinue },
+    { "/blink", MethodPost, 0, 0, &ApplicationWebserver::onBlink },
+    { "/toggle", MethodPost, 0, 0, &ApplicationWebserver::onToggle },
+    { "/", MethodAny, RouteAuth | RouteBlockOta | RoutePage, 0, &ApplicationWebserver::onIndex },
+    { "/webapp", MethodGet, RouteAuth | RouteBlockOta | RoutePage, 0, &ApplicationWebserver::onWebapp },
+    { "/config", MethodGet | MethodPost, RouteAuth | RouteBlockOta, _minimumHeap, &ApplicationWebserver::onConfig },
+    { "/animation", MethodGet | MethodPost, RouteAuth | RouteBlockOta, 0, &ApplicationWebserver::onAnimation },
+    { "/networks", MethodGet, RouteAuth | RouteBlockOta, 0, &ApplicationWebserver::onNetworks },
+    { "/scan_networks", MethodPost, RouteAuth | RouteBlockOta, 0, &ApplicationWebserver::onScanNetworks },
+    { "/connect", MethodGet | MethodPost, RouteAuth | RouteBlockOta, 0, &ApplicationWebserver::onConnect },
+    { "/system", MethodPost, RouteAuth | RouteBlockOta, 0, &ApplicationWebserver::onSystemReq },
+    // the status stays readable during an update, onUpdate refuses a second one itself
+    { "/update", MethodGet | MethodPost, RouteAuth, 0, &ApplicationWebserver::onUpdate },
+    { "/generate_204", MethodAny, 0, 0, &ApplicationWebserver::generate204 },
+};
+
+const int ApplicationWebserver::_numRoutes = sizeof(_routes) / sizeof(_routes[0]);
+
+const ApplicationWebserver::Route ApplicationWebserver::_fileRoute = {
+    nullptr, MethodGet, RouteAuth | RouteBlockOta | RoutePage, 0, &ApplicationWebserver::onFile
+};
+
 ApplicationWebserver::ApplicationWebserver() {
+    static_assert(sizeof(_routes) <= _maxRoutes * sizeof(Route), "increase _maxRoutes");
     _running = false;
 
     // keep some heap space free
@@ -38,26 +80,15 @@ ApplicationWebserver::ApplicationWebserver() {
 }
 
 void ApplicationWebserver::init() {
-    paths.setDefault(HttpPathDelegate(&ApplicationWebserver::onFile, this));
-    paths.set("/", HttpPathDelegate(&ApplicationWebserver::onIndex, this));
-    paths.set("/webapp", HttpPathDelegate(&ApplicationWebserver::onWebapp, this));
-    paths.set("/config", HttpPathDelegate(&ApplicationWebserver::onConfig, this));
-    paths.set("/info", HttpPathDelegate(&ApplicationWebserver::onInfo, this));
-    paths.set("/color", HttpPathDelegate(&ApplicationWebserver::onColor, this));
-    paths.set("/animation", HttpPathDelegate(&ApplicationWebserver::onAnimation, this));
-    paths.set("/networks", HttpPathDelegate(&ApplicationWebserver::onNetworks, this));
-    paths.set("/scan_networks", HttpPathDelegate(&ApplicationWebserver::onScanNetworks, this));
-    paths.set("/system", HttpPathDelegate(&ApplicationWebserver::onSystemReq, this));
-    paths.set("/update", HttpPathDelegate(&ApplicationWebserver::onUpdate, this));
-    paths.set("/connect", HttpPathDelegate(&ApplicationWebserver::onConnect, this));
-    paths.set("/generate_204", HttpPathDelegate(&ApplicationWebserver::generate204, this));
-    paths.set("/ping", HttpPathDelegate(&ApplicationWebserver::onPing, this));
-    paths.set("/stop", HttpPathDelegate(&ApplicationWebserver::onStop, this));
-    paths.set("/skip", HttpPathDelegate(&ApplicationWebserver::onSkip, this));
-    paths.set("/pause", HttpPathDelegate(&ApplicationWebserver::onPause, this));
-    paths.set("/continue", HttpPathDelegate(&ApplicationWebserver::onContinue, this));
-    paths.set("/blink", HttpPathDelegate(&ApplicationWebserver::onBlink, this));
-    paths.set("/toggle", HttpPathDelegate(&ApplicationWebserver::onToggle, this));
+    // all requests except the websocket go through the routing table
+    paths.setDefault(HttpPathDelegate(&ApplicationWebserver::onRequest, this));
+
+    _eventResource = new WebsocketResource();
+    _eventResource->setConnectionHandler(WebSocketDelegate(&ApplicationWebserver::onEventsConnected, this));
+    _eventResource->setDisconnectionHandler(WebSocketDelegate(&ApplicationWebserver::onEventsDisconnected, this));
+    // auth and client limit before the upgrade
+    _eventResource->onHeadersComplete = HttpResourceDelegate(&ApplicationWebserver::onEventsHeaders, this);
+    paths.set("/ws", _eventResource);
     _init = true;
 }
 
@@ -74,41 +105,152 @@ void ApplicationWebserver::stop() {
     _running = false;
 }
 
+void ApplicationWebserver::onRequest(HttpRequest &request, HttpResponse &response) {
+    const uint32_t start = micros();
+    const char* path = request.uri.Path.c_str();
+    const uint16_t method = getMethodMask(request.method);
+
+    // the entry for the method, or the first entry of the path to refuse the method with
+    int index = -1;
+    uint16_t allowed = 0;
+    for (int i=0; i < _numRoutes; ++i) {
+        const Route& route = _routes[i];
+        if (strcmp(route.path, path) != 0)
+            continue;
+
+        allowed |= route.methods;
+        if (index < 0 || (route.methods & method))
+            index = i;
+        if (route.methods & method)
+            break;
+    }
+
+    if (index < 0) {
+        index = _numRoutes;
+        allowed = _fileRoute.methods;
+    }
+
+    const Route& route = index < _numRoutes ? _routes[index] : _fileRoute;
+    RouteStats& stats = _routeStats[index];
+    if (checkRoute(route, allowed, request, response)) {
+        (this->*route.handler)(request, response);
+        ++stats.count;
+    }
+    else {
+        ++stats.rejected;
+    }
+
+    const uint32_t us = micros() - start;
+    stats.totalUs += us;
+    if (us > stats.maxUs)
+        stats.maxUs = us;
+}
+
+bool ApplicationWebserver::checkRoute(const Route& route, uint16_t allowed, HttpRequest &request, HttpResponse &response) {
+    if (route.minHeap > 0 && !checkHeap(response, route.minHeap))
+        return false;
+
+    if ((route.flags & RouteAuth) && !authenticated(request, response))
+        return false;
+
+    if ((route.flags & RouteBlockOta) && app.ota.isProccessing()) {
+        if (route.flags & RoutePage) {
+            response.setContentType("text/plain");
+            response.code = 503;
+            response.sendString("OTA in progress");
+        }
+        else {
+            sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
+        }
+        return false;
+    }
+
+    if (!(allowed & getMethodMask(request.method))) {
+        response.setHeader("Allow", getAllowHeader(allowed));
+        sendApiCode(response, API_CODES::API_BAD_REQUEST, "method not allowed", 405);
+        return false;
+    }
+
+    return true;
+}
+
+uint16_t ApplicationWebserver::getMethodMask(HttpMethod method) {
+    return method < 16 ? 1 << method : 0;
+}
+
+String ApplicationWebserver::getAllowHeader(uint16_t methods) {
+    String allow;
+    if (methods & MethodGet)
+        allow = "GET";
+    if (methods & MethodPost) {
+        if (allow.length() > 0)
+            allow += ", ";
+        allow += "POST";
+    }
+    return allow;
+}
+
+void ApplicationWebserver::fillRouteStats(JsonArray& routes) const {
+    for (int i=0; i <= _numRoutes; ++i) {
+        const RouteStats& stats = _routeStats[i];
+        if (stats.count == 0 && stats.rejected == 0)
+            continue;
+
+        const Route& route = i < _numRoutes ? _routes[i] : _fileRoute;
+        JsonObject& entry = routes.createNestedObject();
+        entry["path"] = route.path ? route.path : "*";
+        entry["methods"] = route.methods;
+        entry["count"] = stats.count;
+        entry["rejected"] = stats.rejected;
+        entry["avg_us"] = stats.totalUs / (stats.count + stats.rejected);
+        entry["max_us"] = stats.maxUs;
+    }
+}
+
 bool ICACHE_FLASH_ATTR ApplicationWebserver::authenticateExec(HttpRequest &request, HttpResponse &response) {
     if (!app.cfg.general.api_secured)
         return true;
 
-    debug_d("ApplicationWebserver::authenticated - checking...");
-
-    String userPass = request.getHeader("Authorization");
-    if (userPass == String::nullstr) {
+    const String header = request.getHeader("Authorization");
+    if (header == String::nullstr) {
         debug_d("ApplicationWebserver::authenticated - No auth header");
         return false; // header missing
     }
 
-    debug_d("ApplicationWebserver::authenticated Auth header: %s", userPass.c_str());
+    // clients repeat the same header: once accepted, it is compared instead of decoded
+    // until the settings are saved again (which may change the password)
+    if (_authGeneration == app.cfg.generation && isEqualConstantTime(header, _authAccepted))
+        return true;
 
     // header in form of: "Basic MTIzNDU2OmFiY2RlZmc="so the 6 is to get to beginning of 64 encoded string
-    userPass = userPass.substring(6); //cut "Basic " from start
-    if (userPass.length() > 50) {
+    if (!header.startsWith("Basic ") || header.length() > 56)
         return false;
-    }
+    String userPass = header.substring(6); //cut "Basic " from start
 
     // workaround for this: https://github.com/SmingHub/Sming/issues/1725
     while(userPass.endsWith("="))
-        userPass = userPass.substring(0, userPass.length() - 2);
-
-    // test code for the issue. Should not spawn 2 extra bytes at the end
-    String s = base64_decode("YWRtaW46dGVzdA==");
-    m_printHex("base64_decode", s.c_str(), s.length());
+        userPass.remove(userPass.length() - 1);
 
     userPass = base64_decode(userPass);
-    debug_d("ApplicationWebserver::authenticated Password: '%s' - Expected password: '%s'", userPass.c_str(), app.cfg.general.api_password.c_str());
-    if (userPass.endsWith(app.cfg.general.api_password)) {
-        return true;
+    const int sep = userPass.indexOf(':');
+    if (sep < 0 || !isEqualConstantTime(userPass.substring(sep + 1), app.cfg.general.api_password)) {
+        debug_d("ApplicationWebserver::authenticated - wrong credentials");
+        return false;
     }
 
-    return false;
+    _authAccepted = header;
+    _authGeneration = app.cfg.generation;
+    return true;
+}
+
+bool ApplicationWebserver::isEqualConstantTime(const String& a, const String& b) {
+    // runtime only depends on the length of a, not on where the strings differ
+    const char* pB = b.c_str();
+    const unsigned lenB = b.length();
+    uint8_t diff = a.length() != lenB;
+    for (unsigned i=0; i < a.length(); ++i)
+        diff |= a[i] ^ (lenB ? pB[i % lenB] : 0);
+    return diff == 0;
 }
 
 bool ICACHE_FLASH_ATTR ApplicationWebserver::authenticated(HttpRequest &request, HttpResponse &response) {
@@ -137,7 +279,7 @@ String ApplicationWebserver::getApiCodeMsg(API_CODES code) {
     }
 }
 
-void ApplicationWebserver::sendApiResponse(HttpResponse &response, JsonObjectStream* stream, int code /* = 200 */) {
+void ApplicationWebserver::sendApiResponse(HttpResponse &response, IDataSourceStream* stream, int code /* = 200 */) {
     if (!checkHeap(response)) {
         delete stream;
         return;
@@ -145,39 +287,49 @@ void ApplicationWebserver::sendApiResponse(HttpResponse &response, JsonObjectStr
 
     response.setAllowCrossDomainOrigin("*");
     if (code != 200) {
-        response.code = 400;
+        response.code = code;
     }
     response.sendDataStream(stream, MIME_JSON);
 }
 
-void ApplicationWebserver::sendApiCode(HttpResponse &response, API_CODES code, String msg /* = "" */) {
-    JsonObjectStream* stream = new JsonObjectStream();
-    JsonObject& json = stream->getRoot();
-    if (msg == "") {
-        msg = getApiCodeMsg(code);
-    }
-    if (code == API_CODES::API_SUCCESS) {
-        json["success"] = true;
-        sendApiResponse(response, stream, 200);
-    } else {
-        json["error"] = msg;
-        sendApiResponse(response, stream, 400);
-    }
+void ApplicationWebserver::sendApiCode(HttpResponse &response, API_CODES code, String msg /* = "" */, int httpCode /* = 400 */) {
+    sendApiResponse(response, createApiCodeResponse(code, msg), code == API_CODES::API_SUCCESS ? 200 : httpCode);
 }
 
-void ApplicationWebserver::onFile(HttpRequest &request, HttpResponse &response) {
+IDataSourceStream* ApplicationWebserver::createApiCodeResponse(API_CODES code, const String& msg /* = "" */) {
+    if (code == API_CODES::API_SUCCESS)
+        return ResponseArena::createStatic(successJson);
 
-    if (!authenticated(request, response)) {
-        return;
+    if (msg == "") {
+        switch (code) {
+        case API_CODES::API_MISSING_PARAM:
+            return ResponseArena::createStatic(missingParamJson);
+        case API_CODES::API_UNAUTHORIZED:
+            return ResponseArena::createStatic(unauthorizedJson);
+        case API_CODES::API_UPDATE_IN_PROGRESS:
+            return ResponseArena::createStatic(updateInProgressJson);
+        default:
+            return ResponseArena::createStatic(badRequestJson);
+        }
     }
 
-    if (app.ota.isProccessing()) {
-        response.setContentType("text/plain");
-        response.code = 503;
-        response.sendString("OTA in progress");
-        return;
+    // the message is referenced, not copied: the tree needs no more than the object
+    StaticJsonBuffer<JSON_OBJECT_SIZE(1)> jsonBuffer;
+    JsonObject& json = jsonBuffer.createObject();
+    json["error"] = msg.c_str();
+    if (json.measureLength() >= ResponseArena::bufferSize) {
+        JsonObjectStream* stream = new JsonObjectStream();
+        stream->getRoot()["error"] = msg;
+        return stream;
     }
 
+    ResponseStream* stream = ResponseArena::create();
+    stream->setLength(json.printTo(stream->getBuffer(), stream->getCapacity()));
+    return stream;
+}
+
+void ApplicationWebserver::onFile(HttpRequest &request, HttpResponse &response) {
+
     if (!app.isFilesystemMounted()) {
         response.setContentType("text/plain");
         response.code = 500;
@@ -193,6 +345,11 @@ void ApplicationWebserver::onFile(HttpRequest &request, HttpResponse &response)
         return;
     }
 
+    if (sendAsset(request, response, file, false))
+        return;
+
+    // not in the index: files written to SPIFFS after mountfs() are served
+    // from SPIFFS as before, without ETag
     if (!fileExist(file) && !fileExist(file + ".gz") && WifiAccessPoint.isEnabled()) {
         //if accesspoint is active and we couldn`t find the file - redirect to index
         debug_d("ApplicationWebserver::onFile redirecting");
@@ -201,22 +358,35 @@ void ApplicationWebserver::onFile(HttpRequest &request, HttpResponse &response)
         response.setCache(86400, true); // It's important to use cache for better performance.
         response.sendFile(file);
     }
-
 }
 
-void ApplicationWebserver::onIndex(HttpRequest &request, HttpResponse &response) {
+bool ApplicationWebserver::sendAsset(HttpRequest &request, HttpResponse &response, const String& name, bool revalidate) {
+    WebAssets::Asset* pAsset = app.webassets.find(name);
+    if (pAsset == nullptr)
+        return false;
 
-    if (!authenticated(request, response)) {
-        return;
-    }
+    const String etag = app.webassets.getETag(*pAsset);
+    if (etag.length() > 0)
+        response.setHeader("ETag", etag);
+    if (revalidate)
+        response.setHeader("Cache-Control", "no-cache");
+    else
+        response.setCache(86400, true); // It's important to use cache for better performance.
 
-    if (app.ota.isProccessing()) {
-        response.setContentType("text/plain");
-        response.code = 503;
-        response.sendString("OTA in progress");
-        return;
+    // answered from the index, without touching SPIFFS
+    if (etag.length() > 0 && request.getHeader("If-None-Match").indexOf(etag) >= 0) {
+        response.code = 304;
+        return true;
     }
 
+    if (pAsset->gzip)
+        response.setHeader("Content-Encoding", "gzip");
+    response.sendDataStream(new FileStream(pAsset->getFileName()), ContentType::fromFullFileName(name));
+    return true;
+}
+
+void ApplicationWebserver::onIndex(HttpRequest &request, HttpResponse &response) {
+
     if (WifiAccessPoint.isEnabled()) {
         response.headers[HTTP_HEADER_LOCATION] = "http://" + WifiAccessPoint.getIP().toString() + "/webapp";
     } else {
@@ -227,40 +397,22 @@ void ApplicationWebserver::onIndex(HttpRequest &request, HttpResponse &response)
 
 void ApplicationWebserver::onWebapp(HttpRequest &request, HttpResponse &response) {
 
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        response.setContentType("text/plain");
-        response.code = 503;
-        response.sendString("OTA in progress");
-        return;
-    }
-
-    if (request.method != HTTP_GET) {
-        response.code = 400;
-        return;
-    }
-
     if (!app.isFilesystemMounted()) {
         response.setContentType("text/plain");
         response.code = 500;
         response.sendString("No filesystem mounted");
         return;
     }
-    if (!WifiStation.isConnected()) {
-        // not yet connected - serve initial settings page
-        response.sendFile("init.html");
-    } else {
-        // we are connected to ap - serve normal settings page
-        response.sendFile("index.html");
-    }
+    // initial settings page until connected to an ap, normal settings page afterwards.
+    // The page behind /webapp changes, so the browser always revalidates
+    const char* page = WifiStation.isConnected() ? "index.html" : "init.html";
+    if (!sendAsset(request, response, page, true))
+        response.code = HTTP_STATUS_NOT_FOUND;
 }
 
-bool ApplicationWebserver::checkHeap(HttpResponse &response) {
+bool ApplicationWebserver::checkHeap(HttpResponse &response, uint minHeap /* = _minimumHeap */) {
     uint fh = system_get_free_heap_size();
-    if (fh < _minimumHeap) {
+    if (fh < minHeap) {
         response.code = 429;
         response.setHeader("Retry-After", "2");
         return false;
@@ -268,24 +420,46 @@ bool ApplicationWebserver::checkHeap(HttpResponse &response) {
     return true;
 }
 
-void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response) {
-    if (!checkHeap(response))
-        return;
+int ApplicationWebserver::onEventsHeaders(HttpServerConnection& connection, HttpRequest &request, HttpResponse &response) {
+    // answered with the status set here instead of an upgrade
+    if (!checkHeap(response) || !authenticated(request, response))
+        return 0;
 
-    if (!authenticated(request, response)) {
-        return;
+    if (_eventClients.count() >= _maxEventClients) {
+        response.code = 503;
+        response.setHeader("Retry-After", "5");
+        return 0;
     }
 
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
+    return _eventResource->checkHeaders(connection, request, response);
+}
+
+void ApplicationWebserver::onEventsConnected(WebSocketConnection& socket) {
+    debug_d("ApplicationWebserver: event client connected (%d)", _eventClients.count() + 1);
+    _eventClients.add(&socket);
+}
+
+void ApplicationWebserver::onEventsDisconnected(WebSocketConnection& socket) {
+    _eventClients.removeElement(&socket);
+    debug_d("ApplicationWebserver: event client disconnected (%d)", _eventClients.count());
+}
+
+void ApplicationWebserver::sendEvent(SharedMessage* pMsg) {
+    if (_eventClients.count() == 0)
         return;
-    }
 
-    if (request.method != HTTP_POST && request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not POST or GET request");
+    // frames wait on the heap until the browser takes them. Color and clock state
+    // are replaced by the next message anyway, so those are dropped when heap runs low
+    if (pMsg->getKind() != SharedMessage::Kind::Ordered && system_get_free_heap_size() < _minimumHeap) {
+        ++_numEventsDropped;
         return;
     }
 
+    for (int i=0; i < _eventClients.count(); ++i)
+        _eventClients[i]->send(pMsg->getData(), pMsg->getLength(), WS_TEXT_FRAME);
+}
+
+void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response) {
     if (request.method == HTTP_POST) {
         String body = request.getBody();
         if (body == NULL) {
@@ -296,6 +470,7 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
         }
 
         bool error = false;
+        API_CODES error_code = API_CODES::API_MISSING_PARAM;
         String error_msg = getApiCodeMsg(API_CODES::API_BAD_REQUEST);
         DynamicJsonBuffer jsonBuffer;
         JsonObject& root = jsonBuffer.parseObject(body);
@@ -305,6 +480,8 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
 
         bool ip_updated = false;
         bool color_updated = false;
+        bool sync_algorithm_updated = false;
+        bool udp_updated = false;
         bool ap_updated = false;
         if (!root.success()) {
             sendApiCode(response, API_CODES::API_BAD_REQUEST, "no root object");
@@ -575,15 +752,36 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
             if (root["sync"]["clock_master_interval"].success()) {
                 app.cfg.sync.clock_master_interval = root["sync"]["clock_master_interval"];
             }
+            if (root["sync"]["clock_master_timestamp"].success()) {
+                app.cfg.sync.clock_master_timestamp = root["sync"]["clock_master_timestamp"];
+            }
             if (root["sync"]["clock_slave_enabled"].success()) {
                 app.cfg.sync.clock_slave_enabled = root["sync"]["clock_slave_enabled"];
             }
+            if (root["sync"]["clock_slave_algorithm"].success()) {
+                const String algorithm = root["sync"]["clock_slave_algorithm"].asString();
+                if (!ApplicationSettings::isValidSlaveAlgorithm(algorithm)) {
+                    error = true;
+                    error_code = API_CODES::API_BAD_REQUEST;
+                    error_msg = "unknown clock_slave_algorithm";
+                }
+                else if (!algorithm.equals(app.cfg.sync.clock_slave_algorithm)) {
+                    app.cfg.sync.clock_slave_algorithm = algorithm;
+                    sync_algorithm_updated = true;
+                }
+            }
             if (root["sync"]["clock_slave_topic"].success()) {
                 app.cfg.sync.clock_slave_topic = root["sync"]["clock_slave_topic"].asString();
             }
             if (root["sync"]["cmd_master_enabled"].success()) {
                 app.cfg.sync.cmd_master_enabled = root["sync"]["cmd_master_enabled"];
             }
+            if (root["sync"]["cmd_master_binary"].success()) {
+                app.cfg.sync.cmd_master_binary = root["sync"]["cmd_master_binary"];
+            }
+            if (root["sync"]["cmd_master_lead_ms"].success()) {
+                app.cfg.sync.cmd_master_lead_ms = root["sync"]["cmd_master_lead_ms"];
+            }
             if (root["sync"]["cmd_slave_enabled"].success()) {
                 app.cfg.sync.cmd_slave_enabled = root["sync"]["cmd_slave_enabled"];
             }
@@ -603,6 +801,31 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
             if (root["sync"]["color_slave_topic"].success()) {
                 app.cfg.sync.color_slave_topic = root["sync"]["color_slave_topic"].asString();
             }
+            if (root["sync"]["udp_enabled"].success()) {
+                app.cfg.sync.udp_enabled = root["sync"]["udp_enabled"];
+                udp_updated = true;
+            }
+            if (root["sync"]["udp_group"].success()) {
+                app.cfg.sync.udp_group = root["sync"]["udp_group"].asString();
+                udp_updated = true;
+            }
+            if (root["sync"]["udp_port"].success()) {
+                app.cfg.sync.udp_port = root["sync"]["udp_port"];
+                udp_updated = true;
+            }
+            if (root["sync"]["udp_key"].success()) {
+                const String key = root["sync"]["udp_key"].asString();
+                uint8_t keyBytes[16];
+                if (key.length() > 0 && !UdpSync::parseKey(key, keyBytes)) {
+                    error = true;
+                    error_code = API_CODES::API_BAD_REQUEST;
+                    error_msg = "udp_key must be 32 hex digits";
+                }
+                else {
+                    app.cfg.sync.udp_key = key;
+                    udp_updated = true;
+                }
+            }
         }
 
         if (root["events"].success()) {
@@ -654,10 +877,19 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
                 app.rgbwwctrl.refresh();
 
             }
+            if (sync_algorithm_updated) {
+                app.rgbwwctrl.initStepSync();
+            }
+            if (udp_updated) {
+                app.udpsync.stop();
+                if (app.cfg.sync.udp_enabled && WifiStation.isConnected())
+                    app.udpsync.start();
+            }
             app.cfg.save();
+            app.mqttclient.updateTopics();
             sendApiCode(response, API_CODES::API_SUCCESS);
         } else {
-            sendApiCode(response, API_CODES::API_MISSING_PARAM, error_msg);
+            sendApiCode(response, error_code, error_msg);
         }
 
     } else {
@@ -723,9 +955,13 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
         JsonObject& sync = json.createNestedObject("sync");
         sync["clock_master_enabled"] = app.cfg.sync.clock_master_enabled;
         sync["clock_master_interval"] = app.cfg.sync.clock_master_interval;
+        sync["clock_master_timestamp"] = app.cfg.sync.clock_master_timestamp;
         sync["clock_slave_enabled"] = app.cfg.sync.clock_slave_enabled;
+        sync["clock_slave_algorithm"] = app.cfg.sync.clock_slave_algorithm.c_str();
         sync["clock_slave_topic"] = app.cfg.sync.clock_slave_topic.c_str();
         sync["cmd_master_enabled"] = app.cfg.sync.cmd_master_enabled;
+        sync["cmd_master_binary"] = app.cfg.sync.cmd_master_binary;
+        sync["cmd_master_lead_ms"] = app.cfg.sync.cmd_master_lead_ms;
         sync["cmd_slave_enabled"] = app.cfg.sync.cmd_slave_enabled;
         sync["cmd_slave_topic"] = app.cfg.sync.cmd_slave_topic.c_str();
 
@@ -733,6 +969,10 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
         sync["color_master_interval_ms"] = app.cfg.sync.color_master_interval_ms;
         sync["color_slave_enabled"] = app.cfg.sync.color_slave_enabled;
         sync["color_slave_topic"] = app.cfg.sync.color_slave_topic.c_str();
+        sync["udp_enabled"] = app.cfg.sync.udp_enabled;
+        sync["udp_group"] = app.cfg.sync.udp_group.c_str();
+        sync["udp_port"] = app.cfg.sync.udp_port;
+        sync["udp_key"] = app.cfg.sync.udp_key.c_str();
 
         JsonObject& events = json.createNestedObject("events");
         events["color_interval_ms"] = app.cfg.events.color_interval_ms;
@@ -751,23 +991,6 @@ void ApplicationWebserver::onConfig(HttpRequest &request, HttpResponse &response
 }
 
 void ApplicationWebserver::onInfo(HttpRequest &request, HttpResponse &response) {
-    if (!checkHeap(response))
-        return;
-
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not GET");
-        return;
-    }
-
     JsonObjectStream* stream = new JsonObjectStream();
     JsonObject& data = stream->getRoot();
     data["deviceid"] = String(system_get_chip_id());
@@ -777,6 +1000,18 @@ void ApplicationWebserver::onInfo(HttpRequest &request, HttpResponse &response)
     data["webapp_version"] = WEBAPP_VERSION;
     data["sming"] = SMING_VERSION;
     data["event_num_clients"] = app.eventserver.activeClients;
+    data["event_coalesced"] = app.eventserver.getNumCoalesced();
+    data["event_overflows"] = app.eventserver.getNumOverflows();
+    data["event_color_fallbacks"] = app.eventserver.getNumColorFallbacks();
+    data["event_ws_clients"] = getNumEventClients();
+    data["event_ws_dropped"] = getNumEventsDropped();
+    data["response_fallbacks"] = ResponseArena::getNumFallbacks();
+    if (app.udpsync.isRunning()) {
+        data["udp_sync_received"] = app.udpsync.getNumReceived();
+        data["udp_sync_lost"] = app.udpsync.getNumLost();
+        data["udp_sync_dropped"] = app.udpsync.getNumDropped();
+        data["udp_sync_rejected"] = app.udpsync.getNumRejected();
+    }
     data["uptime"] = app.getUptime();
     data["heap_free"] = system_get_free_heap_size();
 
@@ -784,6 +1019,17 @@ void ApplicationWebserver::onInfo(HttpRequest &request, HttpResponse &response)
     rgbww["version"] = RGBWW_VERSION;
     rgbww["queuesize"] = RGBWW_ANIMATIONQSIZE;
 
+    JsonObject& tick = data.createNestedObject("tick");
+    tick["interval_us"] = app.rgbwwctrl.getTimerInterval();
+    tick["idle"] = app.rgbwwctrl.isIdle();
+    app.rgbwwctrl.getTickStats().fillJson(tick);
+
+    JsonObject& boot = data.createNestedObject("boot");
+    app.boottimeline.fillJson(boot);
+
+    JsonArray& routes = data.createNestedArray("routes");
+    fillRouteStats(routes);
+
     JsonObject& con = data.createNestedObject("connection");
     con["connected"] = WifiStation.isConnected();
     con["ssid"] = WifiStation.getSSID();
@@ -799,31 +1045,22 @@ void ApplicationWebserver::onInfo(HttpRequest &request, HttpResponse &response)
 
 
 void ApplicationWebserver::onColorGet(HttpRequest &request, HttpResponse &response) {
-    if (!checkHeap(response))
-        return;
-
-    JsonObjectStream* stream = new JsonObjectStream();
-    JsonObject& json = stream->getRoot();
-
-    JsonObject& raw = json.createNestedObject("raw");
-    ChannelOutput output = app.rgbwwctrl.getCurrentOutput();
-    raw["r"] = output.r;
-    raw["g"] = output.g;
-    raw["b"] = output.b;
-    raw["ww"] = output.ww;
-    raw["cw"] = output.cw;
-
-    JsonObject& hsv = json.createNestedObject("hsv");
-    float h, s, v;
-    int ct;
-    HSVCT c = app.rgbwwctrl.getCurrentColor();
-    c.asRadian(h, s, v, ct);
-    hsv["h"] = h;
-    hsv["s"] = s;
-    hsv["v"] = v;
-    hsv["ct"] = ct;
+    sendApiResponse(response, createColorResponse());
+}
 
-    sendApiResponse(response, stream);
+IDataSourceStream* ApplicationWebserver::createColorResponse() {
+    static_assert(ColorJson::maxRawLength + ColorJson::maxHsvLength + 16 <= ResponseArena::bufferSize, "color response exceeds the arena buffers");
+
+    // same values as the color events: hsv in degrees / percent with two decimals
+    ResponseStream* stream = ResponseArena::create();
+    char* const pStart = stream->getBuffer();
+    char* p = ColorJson::writeString(pStart, "{\"raw\":");
+    p = ColorJson::writeRaw(p, app.rgbwwctrl.getCurrentOutput());
+    p = ColorJson::writeString(p, ",\"hsv\":");
+    p = ColorJson::writeHsv(p, app.rgbwwctrl.getCurrentColor());
+    *p++ = '}';
+    stream->setLength(p - pStart);
+    return stream;
 }
 
 void ApplicationWebserver::onColorPost(HttpRequest &request, HttpResponse &response) {
@@ -835,55 +1072,41 @@ void ApplicationWebserver::onColorPost(HttpRequest &request, HttpResponse &respo
     }
 
     String msg;
-    if (!app.jsonproc.onColor(body, msg)) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, msg);
-    }
-    else {
-
-        sendApiCode(response, API_CODES::API_SUCCESS);
-    }
-}
-
-void ApplicationWebserver::onColor(HttpRequest &request, HttpResponse &response) {
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_POST && request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not POST or GET");
+    Vector<String> cmdErrors;
+    const bool success = app.jsonproc.onColor(body.c_str(), body.length(), msg, true, &cmdErrors);
+    if (cmdErrors.count() == 0) {
+        if (!success) {
+            sendApiCode(response, API_CODES::API_BAD_REQUEST, msg);
+        }
+        else {
+            sendApiCode(response, API_CODES::API_SUCCESS);
+        }
         return;
     }
 
-    bool error = false;
-    if (request.method == HTTP_POST) {
-        ApplicationWebserver::onColorPost(request, response);
+    // batch: report the outcome of every command in request order
+    JsonObjectStream* stream = new JsonObjectStream();
+    JsonObject& json = stream->getRoot();
+    if (success) {
+        json["success"] = true;
     } else {
-        ApplicationWebserver::onColorGet(request, response);
+        json["error"] = msg;
     }
 
+    JsonArray& cmds = json.createNestedArray("cmds");
+    for (int i=0; i < cmdErrors.count(); ++i) {
+        JsonObject& cmd = cmds.createNestedObject();
+        if (cmdErrors[i].length() == 0) {
+            cmd["success"] = true;
+        } else {
+            cmd["error"] = cmdErrors[i];
+        }
+    }
+    sendApiResponse(response, stream, success ? 200 : 400);
 }
 
 void ApplicationWebserver::onAnimation(HttpRequest &request, HttpResponse &response) {
 
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_POST && request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not POST or GET");
-        return;
-    }
-
     bool error = false;
     if (request.method == HTTP_POST) {
         String body = request.getBody();
@@ -919,20 +1142,6 @@ bool ApplicationWebserver::isPrintable(String& str) {
 
 void ApplicationWebserver::onNetworks(HttpRequest &request, HttpResponse &response) {
 
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP GET");
-        return;
-    }
-
     JsonObjectStream* stream = new JsonObjectStream();
     JsonObject& json = stream->getRoot();
 
@@ -970,19 +1179,6 @@ void ApplicationWebserver::onNetworks(HttpRequest &request, HttpResponse &respon
 
 void ApplicationWebserver::onScanNetworks(HttpRequest &request, HttpResponse &response) {
 
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
     if (!app.network.isScanning()) {
         app.network.scan();
     }
@@ -992,20 +1188,6 @@ void ApplicationWebserver::onScanNetworks(HttpRequest &request, HttpResponse &re
 
 void ApplicationWebserver::onConnect(HttpRequest &request, HttpResponse &response) {
 
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_POST && request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST or GET");
-        return;
-    }
-
     if (request.method == HTTP_POST) {
 
         String body = request.getBody();
@@ -1058,20 +1240,6 @@ void ApplicationWebserver::onConnect(HttpRequest &request, HttpResponse &respons
 
 void ApplicationWebserver::onSystemReq(HttpRequest &request, HttpResponse &response) {
 
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (app.ota.isProccessing()) {
-        sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
-        return;
-    }
-
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
-
     bool error = false;
     String body = request.getBody();
     if (body == NULL) {
@@ -1093,6 +1261,21 @@ void ApplicationWebserver::onSystemReq(HttpRequest &request, HttpResponse &respo
                 } else {
                     error = true;
                 }
+#ifdef ENABLE_BENCHMARK
+            } else if (cmd.equals("tick_profile")) {
+                // profile cost of the LED update tick. Report is printed to serial console
+                // with "sweep": true once for every combination of the sync and events switches
+                uint32_t ticks = 10 * RGBWW_UPDATEFREQUENCY;
+                if (root["ticks"].success()) {
+                    ticks = root["ticks"].as<int>();
+                }
+                app.rgbwwctrl.startTickProfile(ticks, root["sweep"].as<bool>());
+            } else if (cmd.equals("benchmark")) {
+                // micro benchmarks, results are printed to serial console
+                if (!root["name"].success() || !Benchmark::run(root["name"].asString())) {
+                    error = true;
+                }
+#endif
             } else if (!app.delayedCMD(cmd, 1500)) {
                 error = true;
             }
@@ -1111,16 +1294,6 @@ void ApplicationWebserver::onSystemReq(HttpRequest &request, HttpResponse &respo
 }
 
 void ApplicationWebserver::onUpdate(HttpRequest &request, HttpResponse &response) {
-    if (!authenticated(request, response)) {
-        return;
-    }
-
-    if (request.method != HTTP_POST
-            && request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST or GET");
-        return;
-    }
-
     if (request.method == HTTP_POST) {
         if (app.ota.isProccessing()) {
             sendApiCode(response, API_CODES::API_UPDATE_IN_PROGRESS);
@@ -1167,22 +1340,14 @@ void ApplicationWebserver::onUpdate(HttpRequest &request, HttpResponse &response
 
 //simple call-response to check if we can reach server
 void ApplicationWebserver::onPing(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_GET) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP GET");
-        return;
-    }
-    JsonObjectStream* stream = new JsonObjectStream();
-    JsonObject& json = stream->getRoot();
-    json["ping"] = "pong";
-    sendApiResponse(response, stream);
+    sendApiResponse(response, createPingResponse());
 }
 
-void ApplicationWebserver::onStop(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
+IDataSourceStream* ApplicationWebserver::createPingResponse() {
+    return ResponseArena::createStatic(pingJson);
+}
 
+void ApplicationWebserver::onStop(HttpRequest &request, HttpResponse &response) {
     String msg;
     if (app.jsonproc.onStop(request.getBody(), msg, true)) {
         sendApiCode(response, API_CODES::API_SUCCESS);
@@ -1193,11 +1358,6 @@ void ApplicationWebserver::onStop(HttpRequest &request, HttpResponse &response)
 }
 
 void ApplicationWebserver::onSkip(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
-
     String msg;
     if (app.jsonproc.onSkip(request.getBody(), msg)) {
         sendApiCode(response, API_CODES::API_SUCCESS);
@@ -1208,11 +1368,6 @@ void ApplicationWebserver::onSkip(HttpRequest &request, HttpResponse &response)
 }
 
 void ApplicationWebserver::onPause(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
-
     String msg;
     if (app.jsonproc.onPause(request.getBody(), msg, true)) {
         sendApiCode(response, API_CODES::API_SUCCESS);
@@ -1223,11 +1378,6 @@ void ApplicationWebserver::onPause(HttpRequest &request, HttpResponse &response)
 }
 
 void ApplicationWebserver::onContinue(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
-
     String msg;
     if (app.jsonproc.onContinue(request.getBody(), msg)) {
         sendApiCode(response, API_CODES::API_SUCCESS);
@@ -1238,11 +1388,6 @@ void ApplicationWebserver::onContinue(HttpRequest &request, HttpResponse &respon
 }
 
 void ApplicationWebserver::onBlink(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
-
     String msg;
     if (app.jsonproc.onBlink(request.getBody(), msg)) {
         sendApiCode(response, API_CODES::API_SUCCESS);
@@ -1253,11 +1398,6 @@ void ApplicationWebserver::onBlink(HttpRequest &request, HttpResponse &response)
 }
 
 void ApplicationWebserver::onToggle(HttpRequest &request, HttpResponse &response) {
-    if (request.method != HTTP_POST) {
-        sendApiCode(response, API_CODES::API_BAD_REQUEST, "not HTTP POST");
-        return;
-    }
-
     String msg;
     if (app.jsonproc.onToggle(request.getBody(), msg)) {
         sendApiCode(response, API_CODES::API_SUCCESS);
@@ -50,14 +50,31 @@
 #include <RGBWWLed/RGBWWLed.h>
 #include <SmingCore/SmingCore.h>
 #include <otaupdate.h>
+#include <crc16.h>
+#include <siphash.h>
+#include <settingsstore.h>
 #include <config.h>
+#include <colorstorage.h>
 #include <ledctrl.h>
 #include <networking.h>
+#include <responsearena.h>
 #include <webserver.h>
 #include <mqtt.h>
+#include <udpsync.h>
+#include <sharedmessage.h>
 #include <eventserver.h>
 #include <jsonprocessor.h>
+#include <boottimeline.h>
+#include <webassets.h>
 #include <application.h>
 #include <stepsync.h>
+#include <tickprofiler.h>
+#include <tickscheduler.h>
+#include <tickstats.h>
+#include <jsonpull.h>
+#include <binarycommand.h>
+#include <colorjson.h>
+#include <syncsim.h>
+#include <benchmark.h>
 
 #endif /* RGBWWCTRL_H_ */
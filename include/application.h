@@ -49,6 +49,11 @@ public:
     void switchRom();
 
     void onCommandRelay(const String& method, const JsonObject& json);
+    void onCommandRelay(const String& method, const char* pParams, size_t length);
+    // relay a color command which starts on the given master step
+    void onCommandRelay(const String& method, const char* pParams, size_t length, uint32_t atStep);
+    // start step for relayed color commands, false if they start immediately
+    bool getCommandStartStep(uint32_t& step) const;
     void onWifiConnected(const String& ssid);
     void onButtonTogglePressed(int pin);
 
@@ -63,7 +68,10 @@ public:
     ApplicationSettings cfg;
     EventServer eventserver;
     AppMqttClient mqttclient;
+    UdpSync udpsync;
     JsonProcessor jsonproc;
+    BootTimeline boottimeline;
+    WebAssets webassets;
 
 private:
     void loadbootinfo();
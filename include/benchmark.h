@@ -0,0 +1,53 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+#define SYNC_SIM_FILE ".syncsim"
+
+/**
+ * On-device micro benchmarks, started via /system cmd "benchmark" with the
+ * case name in param "name". Results are printed to the serial console.
+ * Benchmarks run synchronously and block the LED tick while running, so
+ * they are only built with ENABLE_BENCHMARK=1 (see Makefile-user.mk).
+ *
+ * Case "sync_sim" reads its scenario from SYNC_SIM_FILE (JSON), e.g.
+ * {"algo":"pi","slaves":4,"drift":100,"drift_spread":200,"interval":30,
+ *  "duration":3600,"delay":"exponential","delay_min_ms":5,"delay_mean_ms":40,
+ *  "loss":5,"timestamps":true,"trace":true}
+ * "delay" is one of "profile" (ms values in "profile" or the built-in
+ * synthetic broker profile), "uniform" or "exponential". With "trace" the offsets of all slaves
+ * are printed as CSV after every clock message.
+ *
+ * Case "settings" compares decoding the current settings from the former JSON
+ * format with the binary sections of SettingsStore, once from memory and once
+ * including the file read as done at boot (rows json_file and bin_file).
+ *
+ * Case "responses" replays a mix of small API responses built as
+ * JsonObjectStream (as before) and from the ResponseArena, with long lived
+ * allocations in between, and reports the largest free heap block afterwards.
+ */
+class Benchmark {
+public:
+    static bool run(const String& name);
+
+private:
+    struct Result {
+        void add(uint32_t cycles);
+        void print(const char* label) const;
+
+        uint32_t count = 0;
+        uint32_t minCycles = UINT32_MAX;
+        uint32_t maxCycles = 0;
+        uint64_t sum = 0;
+        uint32_t heapUsed = 0;
+    };
+
+    static void runJsonParser();
+    static void runBinaryCommand();
+    static void runColorFormat();
+    static void runStepSync();
+    static void runSyncSim();
+    static void runSettings();
+    static void runResponses();
+    static void printSyncTrace(int timeS, const float* pOffsets, int numSlaves);
+};
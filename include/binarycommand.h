@@ -0,0 +1,118 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+#include "jsonpull.h"
+
+/**
+ * Compact binary encoding of relayed commands (master -> slaves via MQTT).
+ *
+ * A message starts with marker and version, followed by the method id and a
+ * list of records (one per command, several for a "cmds" batch). Color values
+ * are fixed point (value * 100), relative values keep their sign.
+ * The encoder only accepts what it can represent exactly; everything else is
+ * relayed as JSON-RPC, so slaves always understand both formats.
+ *
+ * The MQTT client hands payloads around as C strings, so the encoded bytes are
+ * stuffed to never contain 0x00 (0x00 -> 0x01 0x01, 0x01 -> 0x01 0x02).
+ */
+class BinaryCommand {
+public:
+    enum class Method : uint8_t {
+        Invalid = 0,
+        Color,
+        Direct,
+        Stop,
+        Skip,
+        Pause,
+        Continue,
+        Blink,
+        Toggle,
+    };
+
+    enum RecordFlags {
+        FlagHsv = 0x01,
+        FlagRaw = 0x02,
+        FlagRamp = 0x04,
+        FlagSpeed = 0x08,
+        FlagRequeue = 0x10,
+        FlagFade = 0x20,
+        FlagDirection = 0x40,
+        FlagName = 0x80,
+    };
+
+    enum Queue {
+        QueueNone = 0,
+        QueueSingle,
+        QueueBack,
+        QueueFront,
+        QueueFrontReset,
+    };
+
+    enum Group {
+        GroupHsv,
+        GroupHsvFrom,
+        GroupRaw,
+        GroupRawFrom,
+        GroupCount,
+    };
+
+    static const int numComponents = 5;     // h, s, v, ct or r, g, b, ww, cw
+    static const uint8_t fromBit = 0x40;    // in the presence byte of GroupHsv / GroupRaw
+
+    struct Record {
+        uint8_t flags = 0;
+        uint8_t queue = QueueNone;
+        int8_t direction = 1;
+        int32_t ramp = 0;                   // fixed point
+        uint8_t channels = 0;               // bit per channel: h, s, v, ct
+        uint8_t present[GroupCount] = {0};  // bit per component
+        uint8_t relative[GroupCount] = {0}; // bit per component
+        int32_t values[GroupCount][numComponents] = {{0}};
+        String name;
+
+        inline bool hasValue(int group, int component) const { return present[group] & (1 << component); }
+        inline bool isRelative(int group, int component) const { return relative[group] & (1 << component); }
+    };
+
+    static const uint8_t marker = 0xC7;
+    static const uint8_t version = 1;
+    static const int fixedPointScale = 100;
+
+    static Method getMethod(const String& name);
+    static inline bool isBinary(const String& msg) { return msg.length() > 0 && static_cast<uint8_t>(msg[0]) == marker; }
+
+    static bool encode(const String& method, const char* pParams, size_t length, String& out);
+    static bool encode(const String& method, const JsonObject& params, String& out);
+    static bool decode(const String& msg, Method& method, Vector<Record>& records);
+
+private:
+    static const int _maxRecords = 32;
+    // stack buffer of encode(JsonObject)
+    static const size_t _maxJsonParamsLength = 512;
+
+    // reads the stuffed bytes of a message without copying it
+    class Reader {
+    public:
+        Reader(const String& msg) : _msg(msg) {}
+
+        bool readByte(uint8_t& b);
+        bool readInt32(int32_t& value);
+        bool isAtEnd() const { return _pos >= _msg.length(); }
+
+    private:
+        const String& _msg;
+        unsigned _pos = 0;
+    };
+
+    static bool parseRecord(JsonPullParser& parser, Record& record);
+    static bool parseGroup(JsonPullParser& parser, Record& record, int group);
+    static bool parseFixedPoint(const char* pText, size_t length, int32_t& value, bool& relative);
+
+    static void writeMessage(Method method, const Vector<Record>& records, String& out);
+    static void writeRecord(const Record& record, String& out);
+    static void putByte(String& out, uint8_t b);
+    static void putInt32(String& out, int32_t value);
+
+    static bool readRecord(Reader& reader, Record& record);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+/**
+ * Time (system_get_time(), us since the SDK started) and free heap at the
+ * phases of the boot, up to the first LED tick: the time to first light.
+ * The timeline is kept in RTC user memory and updated on every phase, so
+ * after a crash or watchdog reset during boot the next boot reports how far
+ * the previous one got. RTC memory does not survive a power cut.
+ * Reported on /info ("boot") and printed to serial after the first tick.
+ */
+class BootTimeline {
+public:
+    enum Phase {
+        PhaseInit,
+        PhaseMountFs,
+        PhaseOtaCheck,
+        PhaseConfig,
+        PhaseMqtt,
+        PhaseLedCtrl,
+        PhaseButtons,
+        PhaseNetwork,
+        PhaseWebServer,
+        PhaseSystemReady,
+        PhaseLedStart,
+        PhaseServices,
+        PhaseFirstTick,
+        PhaseCount,
+    };
+
+    // reads the previous timeline from RTC memory and marks PhaseInit, call first
+    void begin();
+    void mark(Phase phase);
+    inline bool isComplete() const { return _current.numPhases == PhaseCount; }
+
+    void fillJson(JsonObject& json) const;
+    void print();
+
+private:
+    struct Entry {
+        uint32_t us;
+        uint32_t heap;
+    };
+
+    struct Record {
+        uint32_t magic;
+        uint8_t resetReason;
+        uint8_t numPhases;      // phases up to the last one marked
+        uint16_t reserved;
+        Entry entries[PhaseCount];
+    };
+
+    static void fillJson(const Record& record, JsonObject& json);
+    static const char* getPhaseName(int phase);
+
+    // behind the rboot RTC data at block 64
+    static const uint32_t _rtcBlock = 96;
+    static const uint32_t _magic = 0x42544C31;
+
+    Record _current;
+    Record _previous;
+    bool _hasPrevious = false;
+    Timer _printTimer;
+};
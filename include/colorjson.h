@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+#include <RGBWWLed/RGBWWLed.h>
+
+/**
+ * Integer only JSON formatting of color values for the publish paths.
+ * HSV is scaled to degrees / percent with two fixed decimals (trailing zeros
+ * are dropped), which matches the precision of the float formatting of
+ * ArduinoJson without any soft float operations.
+ *
+ * All functions write to the given position and return the new end. The
+ * caller provides enough space (see max*Length).
+ */
+class ColorJson {
+public:
+    static const size_t maxHsvLength = 64;
+    static const size_t maxRawLength = 64;
+
+    // {"h":120.5,"s":100,"v":80,"ct":2700}
+    static char* writeHsv(char* p, const HSVCT& color);
+    // {"r":1023,"g":0,"b":0,"ww":0,"cw":0}
+    static char* writeRaw(char* p, const ChannelOutput& raw);
+
+    static char* writeString(char* p, const char* str);
+    static char* writeUInt(char* p, uint32_t value);
+    // value scaled by 100
+    static char* writeFixed(char* p, uint32_t value);
+
+    // HSV in degrees / percent, scaled by 100
+    static void toFixed(const HSVCT& color, uint32_t& h, uint32_t& s, uint32_t& v);
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+// legacy JSON file, migrated into the log on the first load
+#define APP_COLOR_FILE ".color"
+
+// flash location of the log, Makefile-user.mk places it and checks it against spiffs 0 and rom 1
+#if !defined(COLOR_LOG_ADDR) || !defined(COLOR_LOG_SECTORS)
+#error "COLOR_LOG_ADDR and COLOR_LOG_SECTORS are set in Makefile-user.mk"
+#endif
+
+/**
+ * Keeps the color for startup_color "last" as a log of fixed size records in
+ * raw flash outside the file systems, so both ROM slots share it and it
+ * survives OTA updates.
+ * - a save appends a record, the valid record with the highest sequence
+ *   number is the current one
+ * - the sector the log enters next is erased ahead of time while the LEDs
+ *   are idle: an erase blocks for tens of ms. If the log gets there first,
+ *   the sector is erased on entry. Both count as stalls in TickStats
+ * - saving the color of the last record writes nothing
+ * - save() only queues the color: the write runs from a timer, not from the
+ *   LED tick, and saves in quick succession end up as one record
+ */
+class ColorStorage {
+public:
+    // false if neither the log nor the legacy file hold a color
+    bool load(HSVCT& color);
+    void save(const HSVCT& color);
+    // write a queued color right away (before a restart)
+    void flush();
+
+private:
+    struct Record {
+        static const uint16_t marker = 0xC07C;
+
+        uint16_t recordMarker;
+        uint16_t crc;
+        uint32_t seq;
+        int16_t h;
+        int16_t s;
+        int16_t v;
+        int16_t ct;
+    };
+
+    void scan();
+    bool loadLegacy(HSVCT& color);
+    void write(const HSVCT& color);
+    bool readRecord(int index, Record& record) const;
+    static bool isValid(const Record& record);
+    static bool isErased(const Record& record);
+    static uint16_t getCrc(const Record& record);
+    static uint32_t getAddress(int index);
+    int getNextSector() const;
+    bool isSectorErased(int sector) const;
+    void eraseSector(int sector);
+    void scheduleErase();
+    void eraseAhead();
+
+    static const uint32_t _sectorSize = 4096;
+    static const int _recordsPerSector = _sectorSize / sizeof(Record);
+    static const int _numRecords = _recordsPerSector * COLOR_LOG_SECTORS;
+    static_assert(COLOR_LOG_SECTORS >= 2, "the sector erased ahead must not hold the current record");
+    static const int _writeDelayMs = 100;
+    static const int _eraseCheckMs = 1000;
+
+    Timer _writeTimer;
+    Timer _eraseTimer;
+    // sector erased ahead of time for the log to enter, -1 if none
+    int _erasedSector = -1;
+    HSVCT _pending;
+    bool _hasPending = false;
+
+    bool _scanned = false;
+    bool _hasPersisted = false;
+    HSVCT _persisted;
+    uint32_t _nextSeq = 1;
+    int _nextIndex = 0;
+};
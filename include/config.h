@@ -23,6 +23,7 @@
 
 #include <SmingCore/SmingCore.h>
 #include <RGBWWCtrl.h>
+#include "settingsstore.h"
 
 #define APP_SETTINGS_FILE ".cfg"
 #define APP_SETTINGS_VERSION 1
@@ -60,11 +61,15 @@ struct ApplicationSettings {
     struct sync {
         bool clock_master_enabled = false;
         int clock_master_interval = 30;
+        bool clock_master_timestamp = false;    // send "steps,timestamp_us,phase_us"
 
         bool clock_slave_enabled = false;
         String clock_slave_topic= "home/led1/clock";
+        String clock_slave_algorithm = "catchup";  // "catchup" or "pi"
 
         bool cmd_master_enabled = false;
+        bool cmd_master_binary = false;
+        int cmd_master_lead_ms = 0;     // >0: relayed color commands start on the same step everywhere
         bool cmd_slave_enabled = false;
         String cmd_slave_topic = "home/led1/command";
 
@@ -72,6 +77,12 @@ struct ApplicationSettings {
         int color_master_interval_ms = 0;
         bool color_slave_enabled = false;
         String color_slave_topic = "home/led1/color";
+
+        // multicast instead of the MQTT sync topics
+        bool udp_enabled = false;
+        String udp_group = "239.255.77.77";
+        int udp_port = 49200;
+        String udp_key;     // 32 hex digits, shared by all devices of the group
     };
 
     struct events {
@@ -128,133 +139,248 @@ struct ApplicationSettings {
     sync sync;
     events events;
 
+    // counts saves, lets consumers notice changed settings
+    uint32_t generation = 0;
+
+    // binary layout of a section (SettingsStore): append new fields at the end
+    template<class IO> void visitSection(SettingsStore::Section section, IO& io) {
+        switch (section) {
+        case SettingsStore::Section::Network:
+            io(network.connection.mdnshostname);
+            io(network.connection.dhcp);
+            io(network.connection.ip);
+            io(network.connection.netmask);
+            io(network.connection.gateway);
+            io(network.mqtt.enabled);
+            io(network.mqtt.server);
+            io(network.mqtt.port);
+            io(network.mqtt.username);
+            io(network.mqtt.password);
+            io(network.mqtt.topic_base);
+            io(network.ap.secured);
+            io(network.ap.ssid);
+            io(network.ap.password);
+            break;
+
+        case SettingsStore::Section::Color:
+            io(color.hsv.model);
+            io(color.hsv.red);
+            io(color.hsv.yellow);
+            io(color.hsv.green);
+            io(color.hsv.cyan);
+            io(color.hsv.blue);
+            io(color.hsv.magenta);
+            io(color.brightness.red);
+            io(color.brightness.green);
+            io(color.brightness.blue);
+            io(color.brightness.ww);
+            io(color.brightness.cw);
+            io(color.colortemp.ww);
+            io(color.colortemp.cw);
+            io(color.outputmode);
+            io(color.startup_color);
+            break;
+
+        case SettingsStore::Section::Sync:
+            io(sync.clock_master_enabled);
+            io(sync.clock_master_interval);
+            io(sync.clock_master_timestamp);
+            io(sync.clock_slave_enabled);
+            io(sync.clock_slave_topic);
+            io(sync.clock_slave_algorithm);
+            io(sync.cmd_master_enabled);
+            io(sync.cmd_master_binary);
+            io(sync.cmd_master_lead_ms);
+            io(sync.cmd_slave_enabled);
+            io(sync.cmd_slave_topic);
+            io(sync.color_master_enabled);
+            io(sync.color_master_interval_ms);
+            io(sync.color_slave_enabled);
+            io(sync.color_slave_topic);
+            io(sync.udp_enabled);
+            io(sync.udp_group);
+            io(sync.udp_port);
+            io(sync.udp_key);
+            break;
+
+        case SettingsStore::Section::Events:
+            io(events.server_enabled);
+            io(events.color_interval_ms);
+            io(events.color_mininterval_ms);
+            io(events.transfin_interval_ms);
+            break;
+
+        case SettingsStore::Section::General:
+            io(general.api_secured);
+            io(general.api_password);
+            io(general.otaurl);
+            io(general.device_name);
+            io(general.pin_config);
+            io(general.buttons_config);
+            io(general.buttons_debounce_ms);
+            break;
+        }
+    }
+
     void load(bool print = false) {
-        DynamicJsonBuffer jsonBuffer;
-        if (exist()) {
-            int size = fileGetSize(APP_SETTINGS_FILE);
-            char* jsonString = new char[size + 1];
-            fileGetContent(APP_SETTINGS_FILE, jsonString, size + 1);
-            JsonObject& root = jsonBuffer.parseObject(jsonString);
-
-            // connection
-            network.connection.mdnshostname = root["network"]["connection"]["hostname"].asString();
-            network.connection.dhcp = root["network"]["connection"]["dhcp"];
-            network.connection.ip = root["network"]["connection"]["ip"].asString();
-            network.connection.netmask = root["network"]["connection"]["netmask"].asString();
-            network.connection.gateway = root["network"]["connection"]["gateway"].asString();
-
-            // accesspoint
-            network.ap.secured = root["network"]["ap"]["secured"];
-            network.ap.ssid = root["network"]["ap"]["ssid"].asString();
-            network.ap.password = root["network"]["ap"]["password"].asString();
-
-            // mqtt
-            if (root["network"]["mqtt"].success()) {
-                if (root["network"]["mqtt"]["enabled"].success())
-                    network.mqtt.enabled = root["network"]["mqtt"]["enabled"];
-                if (root["network"]["mqtt"]["server"].success())
-                    network.mqtt.server = root["network"]["mqtt"]["server"].asString();
-                if (root["network"]["mqtt"]["port"].success())
-                    network.mqtt.port = root["network"]["mqtt"]["port"];
-                if (root["network"]["mqtt"]["username"].success())
-                    network.mqtt.username = root["network"]["mqtt"]["username"].asString();
-                if (root["network"]["mqtt"]["password"].success())
-                    network.mqtt.password = root["network"]["mqtt"]["password"].asString();
-                if (root["network"]["mqtt"]["topic_base"].success())
-                    network.mqtt.topic_base = root["network"]["mqtt"]["topic_base"].asString();
-            }
-
-            // color
-            color.outputmode = root["color"]["outputmode"];
-            if (root["color"]["startup_color"].success())
-                color.startup_color = root["color"]["startup_color"].asString();
-
-            // hsv
-            color.hsv.model = root["color"]["hsv"]["model"];
-            color.hsv.red = root["color"]["hsv"]["red"];
-            color.hsv.yellow = root["color"]["hsv"]["yellow"];
-            color.hsv.green = root["color"]["hsv"]["green"];
-            color.hsv.cyan = root["color"]["hsv"]["cyan"];
-            color.hsv.blue = root["color"]["hsv"]["blue"];
-            color.hsv.magenta = root["color"]["hsv"]["magenta"];
-
-            // brightness
-            color.brightness.red = root["color"]["brightness"]["red"];
-            color.brightness.green = root["color"]["brightness"]["green"];
-            color.brightness.blue = root["color"]["brightness"]["blue"];
-            color.brightness.ww = root["color"]["brightness"]["ww"];
-            color.brightness.cw = root["color"]["brightness"]["cw"];
-
-            // general
-            if (root["general"].success()) {
-                if (root["general"]["api_password"].success())
-                    general.api_password = root["general"]["api_password"].asString();
-                if (root["general"]["api_secured"].success())
-                    general.api_secured = root["general"]["api_secured"];
-                if (root["general"]["otaurl"].success())
-                    general.otaurl = root["general"]["otaurl"].asString();
-                if (root["general"]["device_name"].success())
-                    general.device_name = root["general"]["device_name"].asString();
-                if (root["general"]["pin_config"].success())
-                    general.pin_config = root["general"]["pin_config"].asString();
-                if (root["general"]["buttons_config"].success())
-                    general.buttons_config = root["general"]["buttons_config"].asString();
-                if (root["general"]["buttons_debounce_ms"].success())
-                    general.buttons_debounce_ms = root["general"]["buttons_debounce_ms"];
-            }
-
-            // sync
-            if (root["sync"].success()) {
-                if (root["sync"]["clock_master_enabled"].success())
-                    sync.clock_master_enabled = root["sync"]["clock_master_enabled"];
-                if (root["sync"]["clock_master_interval"].success())
-                    sync.clock_master_interval = root["sync"]["clock_master_interval"];
-                if (root["sync"]["clock_slave_topic"].success())
-                    sync.clock_slave_topic = root["sync"]["clock_slave_topic"].asString();
-                if (root["sync"]["clock_slave_enabled"].success())
-                    sync.clock_slave_enabled = root["sync"]["clock_slave_enabled"];
-
-                if (root["sync"]["cmd_master_enabled"].success())
-                    sync.cmd_master_enabled = root["sync"]["cmd_master_enabled"];
-                if (root["sync"]["cmd_slave_enabled"].success())
-                    sync.cmd_slave_enabled = root["sync"]["cmd_slave_enabled"];
-                if (root["sync"]["cmd_slave_topic"].success())
-                    sync.cmd_slave_topic = root["sync"]["cmd_slave_topic"].asString();
-
-                if (root["sync"]["color_master_enabled"].success())
-                    sync.color_master_enabled = root["sync"]["color_master_enabled"];
-                if (root["sync"]["color_master_interval_ms"].success())
-                    sync.color_master_interval_ms = root["sync"]["color_master_interval_ms"];
-                if (root["sync"]["color_slave_enabled"].success())
-                    sync.color_slave_enabled = root["sync"]["color_slave_enabled"];
-                if (root["sync"]["color_slave_topic"].success())
-                    sync.color_slave_topic = root["sync"]["color_slave_topic"].asString();
-            }
-
-
-            // events
-            if (root["events"].success()) {
-                if (root["events"]["server_enabled"].success())
-                    events.server_enabled = root["events"]["server_enabled"];
-                if (root["events"]["color_interval_ms"].success())
-                    events.color_interval_ms = root["events"]["color_interval_ms"];
-                if (root["events"]["transfin_interval_ms"].success())
-                    events.transfin_interval_ms = root["events"]["transfin_interval_ms"];
-            }
-
-            if (print) {
-                root.prettyPrintTo(Serial);
-            }
-
-            delete[] jsonString;
+        if (!SettingsStore::load(*this) && fileExist(APP_SETTINGS_FILE)) {
+            // JSON settings of an older firmware
+            debug_i("ApplicationSettings::load: migrating %s", APP_SETTINGS_FILE);
+            String json = fileGetContent(APP_SETTINGS_FILE);
+            DynamicJsonBuffer jsonBuffer;
+            JsonObject& root = jsonBuffer.parseObject(json);
+            importJson(root);
+            sanitizeValues();
+            if (SettingsStore::save(*this))
+                fileDelete(APP_SETTINGS_FILE);
         }
 
         sanitizeValues();
+
+        if (print)
+            printJson();
     }
 
     void save(bool print = false) {
+        SettingsStore::save(*this);
+
+        if (print)
+            printJson();
+    }
+
+    void printJson() {
         DynamicJsonBuffer jsonBuffer;
         JsonObject& root = jsonBuffer.createObject();
+        exportJson(root);
+        root.prettyPrintTo(Serial);
+    }
+
+    void importJson(JsonObject& root) {
+        // connection
+        network.connection.mdnshostname = root["network"]["connection"]["hostname"].asString();
+        network.connection.dhcp = root["network"]["connection"]["dhcp"];
+        network.connection.ip = root["network"]["connection"]["ip"].asString();
+        network.connection.netmask = root["network"]["connection"]["netmask"].asString();
+        network.connection.gateway = root["network"]["connection"]["gateway"].asString();
+
+        // accesspoint
+        network.ap.secured = root["network"]["ap"]["secured"];
+        network.ap.ssid = root["network"]["ap"]["ssid"].asString();
+        network.ap.password = root["network"]["ap"]["password"].asString();
+
+        // mqtt
+        if (root["network"]["mqtt"].success()) {
+            if (root["network"]["mqtt"]["enabled"].success())
+                network.mqtt.enabled = root["network"]["mqtt"]["enabled"];
+            if (root["network"]["mqtt"]["server"].success())
+                network.mqtt.server = root["network"]["mqtt"]["server"].asString();
+            if (root["network"]["mqtt"]["port"].success())
+                network.mqtt.port = root["network"]["mqtt"]["port"];
+            if (root["network"]["mqtt"]["username"].success())
+                network.mqtt.username = root["network"]["mqtt"]["username"].asString();
+            if (root["network"]["mqtt"]["password"].success())
+                network.mqtt.password = root["network"]["mqtt"]["password"].asString();
+            if (root["network"]["mqtt"]["topic_base"].success())
+                network.mqtt.topic_base = root["network"]["mqtt"]["topic_base"].asString();
+        }
+
+        // color
+        color.outputmode = root["color"]["outputmode"];
+        if (root["color"]["startup_color"].success())
+            color.startup_color = root["color"]["startup_color"].asString();
+
+        // hsv
+        color.hsv.model = root["color"]["hsv"]["model"];
+        color.hsv.red = root["color"]["hsv"]["red"];
+        color.hsv.yellow = root["color"]["hsv"]["yellow"];
+        color.hsv.green = root["color"]["hsv"]["green"];
+        color.hsv.cyan = root["color"]["hsv"]["cyan"];
+        color.hsv.blue = root["color"]["hsv"]["blue"];
+        color.hsv.magenta = root["color"]["hsv"]["magenta"];
+
+        // brightness
+        color.brightness.red = root["color"]["brightness"]["red"];
+        color.brightness.green = root["color"]["brightness"]["green"];
+        color.brightness.blue = root["color"]["brightness"]["blue"];
+        color.brightness.ww = root["color"]["brightness"]["ww"];
+        color.brightness.cw = root["color"]["brightness"]["cw"];
+
+        // general
+        if (root["general"].success()) {
+            if (root["general"]["api_password"].success())
+                general.api_password = root["general"]["api_password"].asString();
+            if (root["general"]["api_secured"].success())
+                general.api_secured = root["general"]["api_secured"];
+            if (root["general"]["otaurl"].success())
+                general.otaurl = root["general"]["otaurl"].asString();
+            if (root["general"]["device_name"].success())
+                general.device_name = root["general"]["device_name"].asString();
+            if (root["general"]["pin_config"].success())
+                general.pin_config = root["general"]["pin_config"].asString();
+            if (root["general"]["buttons_config"].success())
+                general.buttons_config = root["general"]["buttons_config"].asString();
+            if (root["general"]["buttons_debounce_ms"].success())
+                general.buttons_debounce_ms = root["general"]["buttons_debounce_ms"];
+        }
+
+        // sync
+        if (root["sync"].success()) {
+            if (root["sync"]["clock_master_enabled"].success())
+                sync.clock_master_enabled = root["sync"]["clock_master_enabled"];
+            if (root["sync"]["clock_master_interval"].success())
+                sync.clock_master_interval = root["sync"]["clock_master_interval"];
+            if (root["sync"]["clock_master_timestamp"].success())
+                sync.clock_master_timestamp = root["sync"]["clock_master_timestamp"];
+            if (root["sync"]["clock_slave_topic"].success())
+                sync.clock_slave_topic = root["sync"]["clock_slave_topic"].asString();
+            if (root["sync"]["clock_slave_enabled"].success())
+                sync.clock_slave_enabled = root["sync"]["clock_slave_enabled"];
+            if (root["sync"]["clock_slave_algorithm"].success())
+                sync.clock_slave_algorithm = root["sync"]["clock_slave_algorithm"].asString();
+
+            if (root["sync"]["cmd_master_enabled"].success())
+                sync.cmd_master_enabled = root["sync"]["cmd_master_enabled"];
+            if (root["sync"]["cmd_master_binary"].success())
+                sync.cmd_master_binary = root["sync"]["cmd_master_binary"];
+            if (root["sync"]["cmd_master_lead_ms"].success())
+                sync.cmd_master_lead_ms = root["sync"]["cmd_master_lead_ms"];
+            if (root["sync"]["cmd_slave_enabled"].success())
+                sync.cmd_slave_enabled = root["sync"]["cmd_slave_enabled"];
+            if (root["sync"]["cmd_slave_topic"].success())
+                sync.cmd_slave_topic = root["sync"]["cmd_slave_topic"].asString();
+
+            if (root["sync"]["color_master_enabled"].success())
+                sync.color_master_enabled = root["sync"]["color_master_enabled"];
+            if (root["sync"]["color_master_interval_ms"].success())
+                sync.color_master_interval_ms = root["sync"]["color_master_interval_ms"];
+            if (root["sync"]["color_slave_enabled"].success())
+                sync.color_slave_enabled = root["sync"]["color_slave_enabled"];
+            if (root["sync"]["color_slave_topic"].success())
+                sync.color_slave_topic = root["sync"]["color_slave_topic"].asString();
+
+            if (root["sync"]["udp_enabled"].success())
+                sync.udp_enabled = root["sync"]["udp_enabled"];
+            if (root["sync"]["udp_group"].success())
+                sync.udp_group = root["sync"]["udp_group"].asString();
+            if (root["sync"]["udp_port"].success())
+                sync.udp_port = root["sync"]["udp_port"];
+            if (root["sync"]["udp_key"].success())
+                sync.udp_key = root["sync"]["udp_key"].asString();
+        }
+
+
+        // events
+        if (root["events"].success()) {
+            if (root["events"]["server_enabled"].success())
+                events.server_enabled = root["events"]["server_enabled"];
+            if (root["events"]["color_interval_ms"].success())
+                events.color_interval_ms = root["events"]["color_interval_ms"];
+            if (root["events"]["transfin_interval_ms"].success())
+                events.transfin_interval_ms = root["events"]["transfin_interval_ms"];
+        }
+    }
+
+    void exportJson(JsonObject& root) {
 
         JsonObject& net = root.createNestedObject("network");
         JsonObject& con = net.createNestedObject("connection");
@@ -305,10 +431,14 @@ struct ApplicationSettings {
         root["sync"] = s;
         s["clock_master_enabled"] = sync.clock_master_enabled;
         s["clock_master_interval"] = sync.clock_master_interval;
+        s["clock_master_timestamp"] = sync.clock_master_timestamp;
         s["clock_slave_enabled"] = sync.clock_slave_enabled;
+        s["clock_slave_algorithm"] = sync.clock_slave_algorithm.c_str();
         s["clock_slave_topic"] = sync.clock_slave_topic.c_str();
 
         s["cmd_master_enabled"] = sync.cmd_master_enabled;
+        s["cmd_master_binary"] = sync.cmd_master_binary;
+        s["cmd_master_lead_ms"] = sync.cmd_master_lead_ms;
         s["cmd_slave_enabled"] = sync.cmd_slave_enabled;
         s["cmd_slave_topic"] = sync.cmd_slave_topic.c_str();
 
@@ -317,6 +447,11 @@ struct ApplicationSettings {
         s["color_slave_enabled"] = sync.color_slave_enabled;
         s["color_slave_topic"] = sync.color_slave_topic.c_str();
 
+        s["udp_enabled"] = sync.udp_enabled;
+        s["udp_group"] = sync.udp_group.c_str();
+        s["udp_port"] = sync.udp_port;
+        s["udp_key"] = sync.udp_key.c_str();
+
         JsonObject& e = jsonBuffer.createObject();
         root["events"] = e;
         e["color_interval_ms"] = events.color_interval_ms;
@@ -334,25 +469,27 @@ struct ApplicationSettings {
         g["buttons_debounce_ms"] = general.buttons_debounce_ms;
         g["settings_ver"] = APP_SETTINGS_VERSION;
 
-        String rootString;
-        if (print) {
-            root.prettyPrintTo(Serial);
-        }
-        root.printTo(rootString);
-        fileSetContent(APP_SETTINGS_FILE, rootString);
     }
 
     bool exist() {
-        return fileExist(APP_SETTINGS_FILE);
+        return SettingsStore::exist() || fileExist(APP_SETTINGS_FILE);
     }
 
     void reset() {
-        if (exist()) {
+        SettingsStore::remove();
+        if (fileExist(APP_SETTINGS_FILE)) {
             fileDelete(APP_SETTINGS_FILE);
         }
     }
 
+    static bool isValidSlaveAlgorithm(const String& algorithm) {
+        return algorithm.equals("catchup") || algorithm.equals("pi");
+    }
+
     void sanitizeValues() {
         sync.clock_master_interval = max(sync.clock_master_interval, 1);
+        sync.cmd_master_lead_ms = min(max(sync.cmd_master_lead_ms, 0), 5000);
+        if (!isValidSlaveAlgorithm(sync.clock_slave_algorithm))
+            sync.clock_slave_algorithm = "catchup";
     }
 };
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-16/CCITT-FALSE, small enough to run per record or section without a table
+inline uint16_t crc16(const void* pData, size_t length, uint16_t crc = 0xFFFF) {
+    const uint8_t* p = static_cast<const uint8_t*>(pData);
+    while (length-- > 0) {
+        crc ^= static_cast<uint16_t>(*p++) << 8;
+        for (int i=0; i < 8; ++i)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
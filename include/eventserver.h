@@ -2,31 +2,142 @@
 
 #include <Wiring/WVector.h>
 
+#include "colorjson.h"
 #include "jsonrpcmessage.h"
+#include "sharedmessage.h"
+
+class TickScheduler;
+
+/**
+ * Compact color frame sent to event clients which switched to binary mode
+ * (method "set_format" with param "format": "binary").
+ * All values are little endian. h is in [0, RGBWW_CALC_HUEWHEELMAX],
+ * s and v are in [0, RGBWW_CALC_MAXVAL]. HSV values are only valid if
+ * flagHsv is set.
+ */
+struct __attribute__((packed)) BinaryColorFrame {
+	static const uint8_t marker = 0xC5;
+	static const uint8_t version = 1;
+	static const uint8_t flagHsv = 0x01;
+
+	uint8_t frameMarker;
+	uint8_t frameVersion;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t seq;
+	uint32_t timestampMs;
+	uint16_t raw[5];
+	uint16_t hsv[4];
+};
 
 class EventServer : public TcpServer{
 public:
 	virtual ~EventServer();
 	void start();
 	void stop();
+	void registerTickTasks(TickScheduler& scheduler);
 
 	void publishCurrentState(const ChannelOutput& raw, const HSVCT* pColor = NULL);
 	void publishTransitionFinished(const String& name, bool requeued = false);
 	void publishKeepAlive();
 	void publishClockSlaveStatus(uint32_t offset, uint32_t interval);
 
+	uint32_t getNumCoalesced() const { return _numCoalesced; }
+	uint32_t getNumOverflows() const { return _numOverflows; }
+	uint32_t getNumColorFallbacks() const { return _numColorFallbacks; }
+
 private:
+	enum class ClientFormat {
+		Json,
+		Binary,
+	};
+
+	static const int _maxOrderedMessages = 8;
+	static const int _numLatestSlots = 2;
+
+	struct ClientInfo {
+		TcpClient* pClient = nullptr;
+		ClientFormat format = ClientFormat::Json;
+
+		// message currently written to the TCP send buffer
+		SharedMessage* pCurrent = nullptr;
+		uint16_t currentOffset = 0;
+
+		// transition_finished, keep_alive etc. are delivered completely and in order
+		SharedMessage* ordered[_maxOrderedMessages] = {nullptr};
+		uint8_t orderedHead = 0;
+		uint8_t orderedCount = 0;
+
+		// color_event and clock_slave_status: only the newest one is kept
+		SharedMessage* latest[_numLatestSlots] = {nullptr};
+
+		uint32_t numCoalesced = 0;
+		// queue overflowed: nothing is queued or written anymore until the disconnect callback removes it
+		bool overflow = false;
+		bool closeRequested = false;
+	};
+
+	// reports acknowledged data, which is when a client can take more of its queue
+	class EventClient : public TcpClient {
+	public:
+		EventClient(tcp_pcb* clientTcp, EventServer& server);
+
+	protected:
+		virtual void onReadyToSendData(TcpConnectionEvent sourceEvent) override;
+
+	private:
+		EventServer& _server;
+	};
+
 	virtual void onClient(TcpClient *client) override;
 	virtual void onClientComplete(TcpClient& client, bool succesfull) override;
+	virtual bool onClientReceive(TcpClient& client, char *data, int size) override;
 
-	void sendToClients(JsonRpcMessage& rpcMsg);
+	void onClientRequest(ClientInfo& info, const String& request);
+	void onSetFormat(ClientInfo& info, JsonRpcMessageIn& rpc);
+	void onGetTickStats(ClientInfo& info, JsonRpcMessageIn& rpc);
+	void sendResponse(ClientInfo& info, const JsonObject& root);
+	int findClient(TcpClient* pClient) const;
+
+	void sendToClients(JsonRpcMessage& rpcMsg, SharedMessage::Kind kind = SharedMessage::Kind::Ordered);
+	void sendColorFrame(const ChannelOutput& raw, const HSVCT* pHsv);
+	SharedMessage* getColorMessage();
+	void broadcast(SharedMessage* pMsg, bool jsonClients, bool binaryClients);
+	void onKeepAliveTimer();
+	void onColorTask();
+
+	void enqueue(ClientInfo& info, SharedMessage* pMsg);
+	SharedMessage* popNextMessage(ClientInfo& info);
+	void releasePending(ClientInfo& info);
+	bool drain(ClientInfo& info);
+	static bool hasLatest(const ClientInfo& info);
+	static int getLatestSlot(SharedMessage::Kind kind);
+	virtual TcpConnection* createClient(tcp_pcb* clientTcp) override;
+	void onClientReady(TcpClient& client);
+	void closeOverflowed();
 
 	static const int _tcpPort = 9090;
 	static const int _connectionTimeout = 120;
 	static const int _keepAliveInterval = 60;
+	static const int _maxRequestSize = 256;
 
     Timer _keepAliveTimer;
 	int _nextId = 1;
 
 	ChannelOutput _lastRaw;
+	uint32_t _lastColorEvent = 0;
+
+	Vector<ClientInfo> _clients;
+	int _numBinaryClients = 0;
+	uint32_t _colorSeq = 0;
+
+	// color events and frames are written into these preallocated messages. The
+	// server keeps a reference to each and refills one no client holds anymore
+	static const int _numColorMessages = 4;
+	static const size_t _colorMessageSize = ColorJson::maxRawLength + ColorJson::maxHsvLength + 96;
+	SharedMessage* _colorMessages[_numColorMessages] = {nullptr};
+	uint32_t _numColorFallbacks = 0;
+
+	uint32_t _numCoalesced = 0;
+	uint32_t _numOverflows = 0;
 };
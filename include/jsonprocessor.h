@@ -3,10 +3,15 @@
 #include <SmingCore/SmingCore.h>
 #include <RGBWWLed/RGBWWLedColor.h>
 
+#include "jsonpull.h"
+#include "binarycommand.h"
+
 
 class JsonProcessor {
 public:
     bool onColor(const String& json, String& msg, bool relay = true);
+    // pCmdErrors receives one entry per command of a "cmds" batch (empty if the command succeeded)
+    bool onColor(const char* pJson, size_t length, String& msg, bool relay = true, Vector<String>* pCmdErrors = nullptr);
     bool onColor(JsonObject& root, String& msg, bool relay = true);
 
     bool onStop(const String& json, String& msg, bool relay = true);
@@ -28,12 +33,15 @@ public:
     bool onToggle(JsonObject& root, String& msg, bool relay = true);
 
     bool onDirect(const String& json, String& msg, bool relay);
+    bool onDirect(const char* pJson, size_t length, String& msg, bool relay);
     bool onDirect(JsonObject& root, String& msg, bool relay);
 
     bool onJsonRpc(const String& json);
+    bool onBinaryCommand(const String& msg);
+    // command relayed by the master, JSON-RPC or binary
+    bool onRelayedCommand(const String& msg);
 
-private:
-
+    // parsed color command, held by APPLedCtrl for commands with a start step
     struct RequestParameters {
         String target;
 
@@ -69,10 +77,45 @@ private:
         QueuePolicy queue = QueuePolicy::Single;
 
         int checkParams(String& errorMsg) const;
+        // longest time the queued animation can change the output,
+        // APPLedCtrl::unknownDuration if that depends on the current color
+        uint32_t getMaxDurationMs() const;
     };
 
+    // execute color commands scheduled with APPLedCtrl::scheduleColorCommands()
+    bool onScheduledColor(Vector<RequestParameters>& cmds, String& msg);
+
+private:
+    friend class Benchmark;
+
     void parseRequestParams(JsonObject& root, RequestParameters& params);
+    // single command in params, a "cmds" batch in cmds (hasCmds)
+    bool parseColor(const char* pJson, size_t length, RequestParameters& params, Vector<RequestParameters>& cmds, bool& hasCmds, String* pRelayCmds, String& msg);
+    bool scheduleColor(uint32_t step, const char* pJson, size_t length, String& msg);
     void addChannelStatesToCmd(JsonObject& root, const RGBWWLed::ChannelList& channels);
 
+    // streaming variants: the parser is positioned right after the ObjectStart token
+    bool parseRequestParams(JsonPullParser& parser, RequestParameters& params);
+    bool parseRequestParam(JsonPullParser& parser, RequestParameters& params);
+    bool parseHsv(JsonPullParser& parser, RequestHSVCT& hsv, RequestParameters& params);
+    bool parseRaw(JsonPullParser& parser, RequestChannelOutput& raw, RequestParameters& params);
+    bool parseChannels(JsonPullParser& parser, RGBWWLed::ChannelList& channels);
+    static bool skipValue(JsonPullParser& parser, JsonPullParser::Token token);
+
     bool onSingleColorCommand(JsonObject& root, String& errorMsg);
+    bool onSingleColorCommand(RequestParameters& params, String& errorMsg);
+    bool onColorBatch(Vector<RequestParameters>& cmds, Vector<String>& errors);
+    bool validateColorBatch(const Vector<RequestParameters>& cmds, Vector<String>& errors);
+    static bool checkQueueDepth(const Vector<RequestParameters>& cmds, Vector<String>& errors);
+    static bool isValidColorCommand(const RequestParameters& params, String& errorMsg);
+    static void appendCompact(String& str, const char* pJson, size_t length);
+
+    static const int _maxBatchCommands = 32;
+    void applyDirect(RequestParameters& params, String& msg);
+    void applyStop(RequestParameters& params, String& msg);
+    void applySkip(RequestParameters& params, String& msg);
+    void applyPause(RequestParameters& params, String& msg);
+    void applyBlink(RequestParameters& params);
+    void applyRecord(const BinaryCommand::Record& record, RequestParameters& params);
+    static AbsOrRelValue toAbsOrRelValue(const BinaryCommand::Record& record, int group, int component, AbsOrRelValue::Type type);
 };
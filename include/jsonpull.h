@@ -0,0 +1,67 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+/**
+ * Minimal single pass JSON tokenizer working directly on the input buffer.
+ * No DOM is built and nothing is allocated: the caller pulls one token after
+ * the other and reads keys and values as slices of the input.
+ *
+ * Like the ArduinoJson parser it accepts unquoted keys and values as well as
+ * single quoted strings.
+ */
+class JsonPullParser {
+public:
+    enum class Token {
+        Error,
+        End,
+        ObjectStart,
+        ObjectEnd,
+        ArrayStart,
+        ArrayEnd,
+        Key,
+        String,
+        Primitive,   // unquoted value: number, true, false, null
+    };
+
+    JsonPullParser(const char* pData, size_t length);
+
+    Token next();
+    bool skipValue();
+    // skip the rest of the object or array whose start token was just returned
+    bool skipContainer();
+
+    // position of the next value (whitespace and separators skipped)
+    size_t getValueStart();
+    inline size_t getPosition() const { return _pos; }
+
+    // text of the last Key, String or Primitive token. Escapes are not resolved
+    inline const char* getText() const { return _pData + _textStart; }
+    inline size_t getTextLength() const { return _textLength; }
+
+    bool textEquals(const char* str) const;
+    size_t getString(char* pBuf, size_t size) const;
+    String getString() const;
+    int getInt() const;
+    double getDouble() const;
+
+private:
+    static const int _maxDepth = 32;
+
+    bool inObject() const;
+    void skipWhitespace();
+    void skipSeparators();
+    Token scanString(char quote);
+    Token scanPrimitive();
+
+    const char* _pData;
+    size_t _length;
+    size_t _pos = 0;
+
+    size_t _textStart = 0;
+    size_t _textLength = 0;
+
+    uint32_t _objectStack = 0;
+    int _depth = 0;
+    bool _expectKey = false;
+};
@@ -21,10 +21,13 @@
  */
 #pragma once
 
+#include "colorstorage.h"
+#include "jsonprocessor.h"
 #include "mqtt.h"
 #include "stepsync.h"
-
-#define APP_COLOR_FILE ".color"
+#include "tickprofiler.h"
+#include "tickscheduler.h"
+#include "tickstats.h"
 
 struct PinConfig {
     PinConfig() : red(13), green(12), blue(14), warmwhite(5), coldwhite(4) {}
@@ -36,47 +39,6 @@ struct PinConfig {
     int coldwhite;
 };
 
-struct ColorStorage {
-    HSVCT current;
-    void load(bool print = false) {
-        StaticJsonBuffer < 72 > jsonBuffer;
-        if (exist()) {
-            int size = fileGetSize(APP_COLOR_FILE);
-            char* jsonString = new char[size + 1];
-            fileGetContent(APP_COLOR_FILE, jsonString, size + 1);
-            JsonObject& root = jsonBuffer.parseObject(jsonString);
-            current.h = root["h"];
-            current.s = root["s"];
-            current.v = root["v"];
-            current.ct = root["ct"];
-            if (print) {
-                root.prettyPrintTo(Serial);
-            }
-            delete[] jsonString;
-        }
-    }
-
-    void save(bool print = false) {
-        debug_d("Saving ColorStorage to file...");
-        DynamicJsonBuffer jsonBuffer;
-        JsonObject& root = jsonBuffer.createObject();
-        root["h"] = current.h;
-        root["s"] = current.s;
-        root["v"] = current.v;
-        root["ct"] = current.ct;
-        String rootString;
-        if (print) {
-            root.prettyPrintTo(Serial);
-        }
-        root.printTo(rootString);
-        fileSetContent(APP_COLOR_FILE, rootString);
-    }
-
-    bool exist() {
-        return fileExist(APP_COLOR_FILE);
-    }
-};
-
 class APPLedCtrl: public RGBWWLed {
 
 public:
@@ -93,18 +55,42 @@ public:
     void toggle();
 
     void updateLed();
+    void startTickProfile(uint32_t numTicks, bool sweep);
+    void initStepSync();
+    const TickStats& getTickStats() const { return _tickStats; }
+    TickStats& getTickStats() { return _tickStats; }
+    uint32_t getTimerInterval() const { return _timerInterval; }
+    inline bool isIdle() const { return _idle; }
+    // leave idle mode: called before anything changes the animations or the output
+    void wake();
+    // wake() before queueing animations that change the output for at most
+    // maxDurationMs from when they start
+    void keepAwake(uint32_t maxDurationMs);
+    // all animation queues were cleared and the running animations skipped
+    void onAnimationsCleared();
+    static const uint32_t unknownDuration = UINT32_MAX;
     void onMasterClock(uint32_t steps);
+    void onMasterClock(uint32_t steps, uint32_t sentUs, uint32_t phaseUs, uint32_t receivedUs);
     void onMasterClockReset();
+
+    inline uint32_t getStepCounter() const { return _stepCounter; }
+    // step of this controller corresponding to the master step (clock slaves only)
+    bool toLocalStep(uint32_t masterStep, uint32_t& localStep) const;
+    // queue the parsed color commands (of one method "color") when the step counter reaches step
+    bool scheduleColorCommands(uint32_t step, const Vector<JsonProcessor::RequestParameters>& cmds);
     virtual void onAnimationFinished(const String& name, bool requeued);
 private:
     static PinConfig parsePinConfigString(String& pinStr);
     static void updateLedCb(void* pTimerArg);
-    void publishToEventServer();
-    void publishToMqtt();
     void publishFinishedStepAnimations();
     void publishColorStayedCmds();
     void checkStableColorState();
+    void checkQuiet(bool animFinished, uint32_t numSteps);
+    uint32_t getTickSteps(uint32_t stepCounter) const;
     void publishStatus();
+    void setSyncInterval(uint32_t interval);
+    void updateMasterStepOffset(uint32_t stepsMaster);
+    void runScheduledCommands();
 
     ColorStorage colorStorage;
 
@@ -112,16 +98,64 @@ private:
     ChannelOutput _lastOutput;
 
     StepSync* _stepSync = nullptr;
+    ClockTransitFilter _transitFilter;
+    // master steps - local steps. A clock message shows it reduced by its
+    // transit delay (with timestamps only by the delay above the fastest
+    // recent message), so the largest offset of the last _offsetWindow
+    // messages is used: the one held back least. Refreshed with every clock
+    // message, it follows the steering of the step sync
+    static const int _offsetWindow = 4;
+    int32_t _masterOffsets[_offsetWindow];
+    int _numMasterOffsets = 0;
+    int _nextMasterOffset = 0;
+    int32_t _masterStepOffset = 0;
+    bool _hasMasterClock = false;
+
+    // parsed when scheduled, the timer callback only queues them
+    struct ScheduledCommand {
+        uint32_t step = 0;
+        bool used = false;
+        Vector<JsonProcessor::RequestParameters> cmds;
+    };
+
+    static const int _maxScheduledCommands = 4;
+    static const uint32_t _maxScheduleAheadSteps = 10 * RGBWW_UPDATEFREQUENCY;
+    ScheduledCommand _scheduledSlots[_maxScheduledCommands];
+    // used slots in the order they were scheduled
+    ScheduledCommand* _scheduled[_maxScheduledCommands] = {nullptr};
+    int _numScheduled = 0;
 
     uint32_t _stepCounter = 0;
     HSVCT _prevColor;
-    uint32_t _numStableColorSteps = 0;
+    uint32_t _stableColorSinceMs = 0;
+    bool _stableColorSaved = false;
     ChannelOutput _prevOutput;
 
     static const uint32_t _saveAfterStableColorMs = 2000;
+    static const int _stableColorCheckMs = 100;
+
+    // idle mode: once nothing changed for _idleAfterQuietMs and no queued
+    // animation can still change the output, a tick covers up to
+    // _idleTickSteps steps and skips show(). RGBWWLed does not tell whether
+    // its queues are empty, so keepAwake() keeps the step by which all
+    // queued animations are done at the latest. Animations of unknown length
+    // (requeued, paused, fades at a given speed) keep the controller awake
+    // until a stop of all channels
+    static const uint32_t _idleAfterQuietMs = 1000;
+    static const uint32_t _idleTickSteps = 10;
+    bool _idle = false;
+    uint32_t _numQuietSteps = 0;
+    uint32_t _busyUntilStep = 0;
+    bool _busyUnbounded = false;
+    // steps covered by the armed timer
+    uint32_t _tickSteps = 1;
 
     ETSTimer _ledTimer;
     uint32_t _timerInterval = RGBWW_MINTIMEDIFF_US;
+    uint32_t _tickStartUs = 0;
     HashMap<String, bool> _stepFinishedAnimations;
-    uint32_t _lastColorEvent = 0;
+
+    TickScheduler _tickScheduler;
+    TickProfiler _tickProfiler;
+    TickStats _tickStats;
 };
@@ -3,6 +3,7 @@
 #include "RGBWWCtrl.h"
 
 class IMasterClockSink;
+class TickScheduler;
 
 
 class AppMqttClient{
@@ -15,22 +16,40 @@ public:
     void start();
     void stop();
     bool isRunning() const;
+    void updateTopics();
+    void registerTickTasks(TickScheduler& scheduler);
 
     void publishCurrentHsv(const HSVCT& color);
     void publishCurrentRaw(const ChannelOutput& raw);
-    void publishClock(uint32_t steps);
+    void publishClock(uint32_t steps, uint32_t phaseUs = 0);
     void publishClockReset();
     void publishClockInterval(uint32_t curInterval);
     void publishClockSlaveOffset(uint32_t offset);
     void publishCommand(const String& method, const JsonObject& params);
+    void publishCommand(const String& method, const char* pParams, size_t length);
+    void publishScheduledCommand(const String& method, const char* pParams, size_t length, uint32_t atStep);
     void publishTransitionFinished(const String& name, bool requeued);
 
 private:
+    enum Topic {
+        TopicColor,
+        TopicClock,
+        TopicClockInterval,
+        TopicClockSlaveOffset,
+        TopicCommand,
+        TopicTransitionFinished,
+        TopicCount,
+    };
+
     void connectDelayed(int delay = 2000);
     void connect();
     void onComplete(TcpClient& client, bool success);
     void onMessageReceived(String topic, String message);
+    void onColorTask();
     void publish(const String& topic, const String& data, bool retain);
+    // color and command payloads, via MQTT or the UDP sync channel
+    void publishSync(Topic topic, const String& data, bool retain);
+    void publishJsonRpcCommand(const String& method, const char* pParams, size_t length, const uint32_t* pAtStep);
 
     String buildTopic(const String& suffix);
 
@@ -38,6 +57,9 @@ private:
     bool _running = false;
     Timer _procTimer;
     String _id;
+
+    // built once by updateTopics() instead of on every publish
+    String _topics[TopicCount];
     bool _firstClock = true;
 
     HSVCT _lastHsv;
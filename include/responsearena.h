@@ -0,0 +1,67 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+class ResponseStream;
+
+/**
+ * A few fixed slots for the small responses of the API (color state, error
+ * messages). A slot holds the ResponseStream and the buffer of its body, so
+ * a request neither leaves a JsonObjectStream and its JSON tree behind in
+ * the heap nor allocates the stream. With all slots in use, a slot is taken
+ * from the heap as one block. Larger responses (/info, /config, /networks)
+ * still use a JsonObjectStream.
+ */
+class ResponseArena {
+public:
+    static const int numSlots = 4;
+    static const size_t bufferSize = 256;
+
+    // empty stream of bufferSize capacity, fill getBuffer() and call setLength()
+    static ResponseStream* create();
+    // constant body, pFlash is PROGMEM
+    static ResponseStream* createStatic(const char* pFlash);
+
+    static uint32_t getNumFallbacks() { return _numFallbacks; }
+
+private:
+    friend class ResponseStream;
+    static void* allocate();
+    static void release(void* pSlot);
+    static char* getBuffer(void* pSlot);
+
+    static uint32_t _numFallbacks;
+};
+
+/**
+ * Response body of the API, either constant data in flash or the buffer of
+ * its arena slot. The webserver deletes the stream once the body is sent,
+ * which returns the slot to the arena.
+ */
+class ResponseStream : public IDataSourceStream {
+public:
+    char* getBuffer() { return _pBuffer; }
+    size_t getCapacity() const { return _pFlash ? 0 : ResponseArena::bufferSize; }
+    void setLength(size_t length) { _length = std::min(length, getCapacity()); }
+
+    virtual StreamType getStreamType() override { return eSST_Memory; }
+    virtual uint16_t readMemoryBlock(char* data, int bufSize) override;
+    virtual bool seek(int len) override;
+    virtual bool isFinished() override { return _pos >= _length; }
+    virtual int available() override { return _length - _pos; }
+
+    // the stream lives in an arena slot
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+
+private:
+    friend class ResponseArena;
+    ResponseStream();
+    // pFlash points to PROGMEM data
+    ResponseStream(const char* pFlash, size_t length);
+
+    char* _pBuffer;
+    const char* _pFlash = nullptr;
+    size_t _length = 0;
+    size_t _pos = 0;
+};
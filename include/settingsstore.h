@@ -0,0 +1,113 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+#define APP_SETTINGS_BINARY_FILE ".cfgb"
+#define APP_SETTINGS_BINARY_TEMP_FILE ".cfgb.tmp"
+
+struct ApplicationSettings;
+
+/**
+ * Binary settings file:
+ *   FileHeader
+ *   SectionEntry[numSections]
+ *   section data, in the order of the table
+ *
+ * A section is the list of its fields in the order given by
+ * ApplicationSettings::visitSection(): bool as 1 byte, int and float as 4
+ * bytes little endian, IPAddress as 4 bytes, String as a 2 byte length and
+ * the characters. New fields are appended to their section: older files end
+ * early and the new fields keep their defaults. Incompatible layout changes
+ * bump the section version, sections of an unknown version are skipped.
+ *
+ * Every section has its own CRC, a damaged section falls back to the
+ * defaults without affecting the others. If the length of every section is
+ * unchanged, save() only rewrites the changed sections and the table in place.
+ * Otherwise it writes a new file and renames it over the old one: a reset in
+ * between leaves either the old or the new settings, load() finishes the rename.
+ */
+class SettingsStore {
+public:
+    enum class Section : uint8_t {
+        Network = 1,
+        Color,
+        Sync,
+        Events,
+        General,
+    };
+
+    struct __attribute__((packed)) FileHeader {
+        static const uint32_t magic = 0x53424752;   // "RGBS"
+        static const uint16_t version = 1;
+
+        uint32_t fileMagic;
+        uint16_t fileVersion;
+        uint16_t numSections;
+        uint32_t generation;
+    };
+
+    struct __attribute__((packed)) SectionEntry {
+        uint8_t id;
+        uint8_t version;
+        uint16_t length;
+        uint32_t offset;
+        uint16_t crc;
+        uint16_t reserved;
+    };
+
+    // appends the fields of a section to a buffer
+    class Writer {
+    public:
+        Writer(uint8_t* pBuf, size_t size) : _pBuf(pBuf), _size(size) {}
+
+        void operator()(bool& value);
+        void operator()(int& value);
+        void operator()(float& value);
+        void operator()(IPAddress& value);
+        void operator()(String& value);
+
+        size_t getLength() const { return _length; }
+        bool isOverflow() const { return _overflow; }
+
+    private:
+        void write(const void* pData, size_t length);
+
+        uint8_t* _pBuf;
+        size_t _size;
+        size_t _length = 0;
+        bool _overflow = false;
+    };
+
+    // reads the fields of a section, fields past the end keep their value
+    class Reader {
+    public:
+        Reader(const uint8_t* pData, size_t length) : _pData(pData), _length(length) {}
+
+        void operator()(bool& value);
+        void operator()(int& value);
+        void operator()(float& value);
+        void operator()(IPAddress& value);
+        void operator()(String& value);
+
+    private:
+        bool read(void* pData, size_t length);
+
+        const uint8_t* _pData;
+        size_t _length;
+        size_t _pos = 0;
+    };
+
+    static bool exist();
+    static bool load(ApplicationSettings& cfg);
+    static bool save(ApplicationSettings& cfg);
+    static void remove();
+
+    static const Section sections[];
+    static const int numSections = 5;
+    static const uint8_t sectionVersion = 1;
+    static const size_t maxSectionSize = 1024;
+
+private:
+    // completes or drops a new file left by an interrupted save()
+    static void recoverTempFile();
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+/**
+ * Immutable, reference counted message buffer. A message is serialized once
+ * and every connection streams from the same memory. The last owner calling
+ * release() frees it.
+ */
+class SharedMessage {
+public:
+    enum class Kind {
+        Ordered,        // must be delivered to every client in order
+        Color,          // only the newest one matters, stale ones may be dropped
+        ClockStatus,    // only the newest one matters, stale ones may be dropped
+    };
+
+    static SharedMessage* create(const char* pData, size_t length, Kind kind);
+    static SharedMessage* create(const JsonObject& json, Kind kind);
+    // empty message of up to capacity bytes: fill getBuffer(), then setLength().
+    // An owner that keeps its reference may refill it once isShared() is false
+    static SharedMessage* createBuffer(size_t capacity, Kind kind);
+
+    inline void addRef() { ++_refCount; }
+    void release();
+
+    inline const char* getData() const { return _pData; }
+    inline size_t getLength() const { return _length; }
+    inline Kind getKind() const { return _kind; }
+    inline bool isShared() const { return _refCount > 1; }
+    inline char* getBuffer() { return _pData; }
+    void setLength(size_t length);
+
+private:
+    SharedMessage(size_t length, Kind kind);
+    ~SharedMessage();
+
+    char* _pData = nullptr;
+    size_t _length = 0;
+    Kind _kind;
+    uint16_t _refCount = 1;
+};
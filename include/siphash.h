@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// SipHash-2-4: keyed MAC for short messages, 64 bit tag with a 128 bit key
+uint64_t siphash24(const uint8_t key[16], const void* pData, size_t length);
@@ -7,6 +7,9 @@ class StepSync {
 public:
     virtual ~StepSync();
     virtual uint32_t onMasterClock(uint32_t stepsCurrent, uint32_t stepsMaster) = 0;
+    // masterAhead: fraction of a step the master is ahead beyond stepsMaster
+    // (tick phase and transit delay). Rounded to whole steps by default
+    virtual uint32_t onMasterClockTimed(uint32_t stepsCurrent, uint32_t stepsMaster, float masterAhead);
     virtual int getCatchupOffset() const = 0;
     virtual uint32_t reset() = 0;
 
@@ -39,3 +42,74 @@ private:
     double _steering = 1.0;
     const uint32_t _constBaseInt = RGBWW_MINTIMEDIFF_US;
 };
+
+
+/**
+ * Proportional-integral servo on the accumulated step offset.
+ * The P part removes the phase error, the I part learns the crystal drift.
+ * Each clock message is compared with the offset predicted from the drift
+ * estimate and the correction applied since the last one. The jitter of that
+ * prediction error is estimated (EWMA, like the TCP RTT variance) and messages
+ * which deviate far beyond it are treated as delayed by the broker and ignored.
+ */
+class ClockPIServo : public StepSync {
+public:
+    virtual uint32_t onMasterClock(uint32_t stepsCurrent, uint32_t stepsMaster) override;
+    virtual uint32_t onMasterClockTimed(uint32_t stepsCurrent, uint32_t stepsMaster, float masterAhead) override;
+    virtual int getCatchupOffset() const override;
+    virtual uint32_t reset() override;
+
+    float getJitter() const { return _jitter; }
+    uint32_t getNumRejected() const { return _numRejected; }
+
+private:
+    uint32_t update(uint32_t stepsCurrent, uint32_t stepsMaster, float masterAhead);
+
+    static constexpr float _kp = 0.5f;
+    static constexpr float _ki = 0.1f;
+    static constexpr float _maxIntegralCorrection = 0.1f;  // of the base rate
+    static constexpr float _maxCorrection = 0.5f;
+    static constexpr float _jitterGain = 0.125f;
+    static constexpr float _outlierFactor = 4.0f;
+    static constexpr float _outlierMinSteps = 3.0f;
+    static const uint32_t _minSamplesForRejection = 2;
+    static const uint32_t _maxConsecutiveRejects = 3;
+
+    uint32_t _stepsSyncMasterLast = 0;
+    uint32_t _stepsSyncLast = 0;
+    float _masterAheadLast = 0;
+    bool _firstMasterSync = true;
+
+    float _offset = 0;          // accumulated offset including fractional steps
+    float _integral = 0;
+    float _correction = 0;      // rate correction currently applied
+    float _driftRate = 0;       // estimated offset per master step without correction
+    float _jitter = 0;
+    uint32_t _numAccepted = 0;
+    uint32_t _numConsecutiveRejects = 0;
+    uint32_t _numRejected = 0;
+
+    uint32_t _interval = RGBWW_MINTIMEDIFF_US;
+    const uint32_t _constBaseInt = RGBWW_MINTIMEDIFF_US;
+};
+
+
+/**
+ * Estimates how much longer a timestamped clock message travelled than the
+ * fastest of the recent ones. Master and slave clocks are not synchronized,
+ * so only the differences of the transit times are meaningful. The window is
+ * kept short as the crystal drift between the two clocks adds up over it.
+ */
+class ClockTransitFilter {
+public:
+    // returns the extra delay of this message in us
+    uint32_t onMessage(uint32_t sentUs, uint32_t receivedUs);
+    void reset();
+
+private:
+    static const int _window = 4;
+
+    uint32_t _transits[_window];
+    int _numTransits = 0;
+    int _next = 0;
+};
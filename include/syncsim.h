@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+class StepSync;
+
+/**
+ * Replays a master clock and N slaves, each driven by its own StepSync
+ * instance. Every slave crystal drifts by a fixed amount; the drifts are
+ * spread evenly over [driftPpm - driftSpreadPpm, driftPpm + driftSpreadPpm].
+ * Clock messages are delayed per slave according to the delay model and
+ * may be lost. With timestamps the slaves compensate the delay like for
+ * "steps,timestamp_us,phase_us" clock messages.
+ * Time is simulated, a run over hours takes a few ms per slave.
+ */
+class SyncSimulator {
+public:
+    enum class DelayModel {
+        Profile,        // pDelaysMs used round robin, shifted per slave
+        Uniform,        // delayMinMs + [0, 2 * delayMeanMs]
+        Exponential,    // delayMinMs + exponential with mean delayMeanMs
+    };
+
+    struct Config {
+        int numSlaves = 1;
+        int driftPpm = 200;
+        int driftSpreadPpm = 0;
+        int masterIntervalS = 30;
+        int durationS = 3600;
+
+        DelayModel delayModel = DelayModel::Profile;
+        const uint16_t* pDelaysMs = nullptr;
+        int numDelays = 0;
+        int delayMinMs = 0;
+        int delayMeanMs = 0;
+
+        int lossPercent = 0;
+        bool timestamps = false;
+        uint32_t seed = 1;
+    };
+
+    struct Result {
+        int convergenceS = 0;       // time after which all offsets stay within one step
+        float meanAbsOffset = 0;    // steps to the master, second half of the run
+        float maxAbsOffset = 0;     // steps to the master, second half of the run
+        float maxSpread = 0;        // steps between the slaves, second half of the run
+        int numSyncs = 0;
+        int numLost = 0;
+    };
+
+    // called after every clock message with the true offsets (steps) of all slaves
+    typedef Delegate<void(int timeS, const float* pOffsets, int numSlaves)> TraceDelegate;
+
+    static const int maxSlaves = 16;
+
+    static Result run(StepSync& sync, const Config& cfg);
+    static Result run(StepSync* const* ppSlaves, const Config& cfg, TraceDelegate trace = TraceDelegate());
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+/**
+ * Measures the cost of the single phases of APPLedCtrl::updateLed() over a
+ * number of ticks. Results are kept in small logarithmic histograms so
+ * percentiles can be reported without storing every sample.
+ *
+ * The report is printed from a timer after the last tick, not from the LED
+ * tick. A sweep profiles one run for every combination of the switches
+ * read by the tick (sync clock_master_enabled, color_master_enabled and
+ * events server_enabled) and restores them afterwards.
+ */
+class TickProfiler {
+public:
+    enum Phase {
+        PhaseScheduled,
+        PhaseShow,
+        PhaseClockMaster,
+        PhaseEvents,
+        PhaseMqtt,
+        PhaseStableColor,
+        PhaseTransFinished,
+        PhaseTotal,
+        PhaseCount,
+    };
+
+    ~TickProfiler();
+
+    void start(uint32_t numTicks, bool sweep = false);
+    void stop();
+#ifdef ENABLE_BENCHMARK
+    inline bool isActive() const { return _remainingTicks > 0; }
+#else
+    // only built with ENABLE_BENCHMARK, the hooks in the tick compile to nothing
+    inline bool isActive() const { return false; }
+#endif
+
+    inline void beginTick() {
+        if (!isActive())
+            return;
+        _tickStart = _phaseStart = getCycleCount();
+    }
+
+    inline void endPhase(Phase phase) {
+        if (!isActive())
+            return;
+        const uint32_t now = getCycleCount();
+        _pHistograms[phase].add(now - _phaseStart);
+        _phaseStart = now;
+    }
+
+    void endTick();
+
+    static inline uint32_t getCycleCount() {
+        uint32_t ccount;
+        __asm__ __volatile__("rsr %0,ccount" : "=a" (ccount));
+        return ccount;
+    }
+
+    static const uint32_t maxTicks = 65535;
+
+private:
+    struct Histogram {
+        // 4 sub buckets per power of two -> max. 25% error on reported percentiles
+        static const int subBucketBits = 2;
+        static const int numBuckets = 32 << subBucketBits;
+
+        void add(uint32_t value);
+        uint32_t getPercentile(uint32_t permille) const;
+
+        static int getBucket(uint32_t value);
+        static uint32_t getBucketLowerBound(int bucket);
+
+        uint16_t buckets[numBuckets] = {0};
+        uint32_t count = 0;
+        uint32_t maxValue = 0;
+        uint64_t sum = 0;
+    };
+
+    // bit 0: clock master, bit 1: color master, bit 2: event server
+    static const int numCombinations = 8;
+
+    void beginRun();
+    void onReportTimer();
+    void printReport() const;
+    void applyCombination(int combination);
+
+    static const char* getPhaseName(Phase phase);
+
+    Histogram* _pHistograms = nullptr;
+    Timer _reportTimer;
+    uint32_t _numTicks = 0;
+    uint32_t _remainingTicks = 0;
+
+    // index of the running combination, -1 without sweep
+    int _combination = -1;
+    int _savedCombination = 0;
+
+    uint32_t _tickStart = 0;
+    uint32_t _phaseStart = 0;
+};
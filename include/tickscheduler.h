@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+#include "tickprofiler.h"
+
+/**
+ * Periodic tasks run by the LED tick (event server, MQTT, color persistence).
+ * Every task keeps the millis() time it is due next. This replaces testing
+ * the step counter with a modulo: intervals hold while StepSync steers the
+ * tick interval or the tick covers several steps, and the times survive
+ * wrapping.
+ *
+ * Intervals are read on every tick from the referenced value, usually a
+ * config member, so changes apply without registering again:
+ *   < 0  task disabled
+ *   0    task runs on every tick
+ *   > 0  task runs once per interval
+ */
+class TickScheduler {
+public:
+    typedef Delegate<void()> TaskDelegate;
+
+    // runOnAnimFinished: the task also runs on ticks where an animation finished
+    bool addTask(const int* pIntervalMs, TaskDelegate callback, TickProfiler::Phase phase, bool runOnAnimFinished = false);
+    // every task ends a phase of the profiler, run or not
+    void run(uint32_t nowMs, bool animFinished, TickProfiler& profiler);
+
+    static const int maxTasks = 6;
+
+private:
+    struct Task {
+        const int* pIntervalMs = nullptr;
+        TaskDelegate callback;
+        TickProfiler::Phase phase = TickProfiler::PhaseTotal;
+        bool runOnAnimFinished = false;
+        uint32_t dueMs = 0;
+    };
+
+    Task _tasks[maxTasks];
+    int _numTasks = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+/**
+ * Lightweight, always-on statistics about the LED timer tick: how late each
+ * tick fired compared to when it was scheduled and how long its body ran.
+ * The last samples are kept in a ring buffer (for percentiles), all samples
+ * are counted in a coarse histogram.
+ */
+class TickStats {
+public:
+    inline void onTickStart(uint32_t nowUs) {
+        _tickStartUs = nowUs;
+        if (_nextDueUs != 0)
+            _lateness = static_cast<int32_t>(nowUs - _nextDueUs);
+        else
+            _lateness = 0;
+    }
+
+    inline void onTimerArmed(uint32_t nowUs, uint32_t intervalUs) {
+        _nextDueUs = nowUs + intervalUs;
+    }
+
+    void onTickEnd(uint32_t nowUs, uint32_t intervalUs);
+    // work outside of the tick that blocked it, e.g. a flash erase
+    void onStall(uint32_t stallUs);
+
+    void reset();
+    void fillJson(JsonObject& json) const;
+
+    static const int numSamples = 64;
+    static const int numBuckets = 8;
+
+private:
+    static int getBucket(uint32_t us);
+    static uint16_t getPercentile(const uint16_t* pRing, int count, int percent);
+
+    static const uint32_t _bucketLimitsUs[numBuckets - 1];
+
+    uint32_t _tickStartUs = 0;
+    uint32_t _nextDueUs = 0;
+    int32_t _lateness = 0;
+
+    uint16_t _latenessRing[numSamples] = {0};
+    uint16_t _execRing[numSamples] = {0};
+    int _ringPos = 0;
+    int _ringCount = 0;
+
+    uint32_t _latenessHist[numBuckets] = {0};
+    uint32_t _execHist[numBuckets] = {0};
+
+    uint32_t _numTicks = 0;
+    uint32_t _numOverruns = 0;
+    uint32_t _maxLatenessUs = 0;
+    uint32_t _maxExecUs = 0;
+    uint32_t _numStalls = 0;
+    uint32_t _maxStallUs = 0;
+};
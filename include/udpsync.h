@@ -0,0 +1,113 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+
+/**
+ * Broker-less sync channel: clock ticks, relayed commands and color state as
+ * UDP multicast datagrams (config sync.udp_enabled / udp_group / udp_port).
+ * Masters and slaves keep their roles from the sync config, the multicast
+ * group takes the place of the topics. While enabled the MQTT sync topics
+ * are neither published nor subscribed.
+ *
+ * Every datagram starts with a Header. Its mac is the SipHash-2-4 of the whole
+ * datagram (with mac zeroed) under the shared key sync.udp_key (32 hex
+ * digits), datagrams with a wrong mac are dropped. Without a valid key the
+ * channel does not start. The mac does not stop a replay of datagrams
+ * recorded from an earlier session of a sender.
+ * Sequence numbers are counted per sender and shared by all types:
+ * - clock and color datagrams older than the newest one received are stale
+ *   and dropped
+ * - commands are sent _commandCopies times and deduplicated with a window
+ *   over the last 32 sequence numbers, so a reordered command still passes
+ *
+ * Payloads:
+ *   Clock       ClockPayload
+ *   ClockReset  empty, sent before the first clock of a session
+ *   Command     the MQTT command payload (JSON-RPC or binary)
+ *   Color       the MQTT color payload (JSON)
+ */
+class UdpSync {
+public:
+    enum class Type : uint8_t {
+        Clock = 1,
+        ClockReset,
+        Command,
+        Color,
+    };
+
+    struct __attribute__((packed)) Header {
+        static const uint8_t marker = 0xC9;
+        static const uint8_t version = 2;
+
+        uint8_t headerMarker;
+        uint8_t headerVersion;
+        uint8_t type;
+        uint8_t reserved;
+        uint32_t senderId;
+        uint32_t session;   // random per boot: a new session resets the receive state
+        uint32_t seq;
+        uint8_t mac[8];
+    };
+
+    struct __attribute__((packed)) ClockPayload {
+        uint32_t steps;
+        uint32_t timestampUs;
+        uint32_t phaseUs;
+    };
+
+    ~UdpSync();
+    void start();
+    void stop();
+    inline bool isRunning() const { return _pUdp != nullptr; }
+
+    void sendClock(uint32_t steps, uint32_t phaseUs);
+    void sendCommand(const String& payload);
+    void sendColor(const String& payload);
+
+    uint32_t getNumReceived() const { return _numReceived; }
+    uint32_t getNumLost() const { return _numLost; }
+    uint32_t getNumDropped() const { return _numDropped; }
+    uint32_t getNumRejected() const { return _numRejected; }
+
+    // sync.udp_key: 32 hex digits, pKey receives 16 bytes
+    static bool parseKey(const String& hex, uint8_t* pKey);
+
+private:
+    struct SenderState {
+        uint32_t senderId = 0;
+        uint32_t session = 0;
+        uint32_t highestSeq = 0;
+        uint32_t seenMask = 0;      // bit n: highestSeq - n was received
+        uint32_t lastUsedMs = 0;
+    };
+
+    void onReceive(UdpConnection& connection, char* data, int size, IPAddress remoteIP, uint16_t remotePort);
+    void dispatch(Type type, const char* pPayload, size_t length, uint32_t receivedUs);
+    bool acceptSeq(const Header& header, bool newestOnly);
+    SenderState& getSender(const Header& header);
+    void send(Type type, const char* pPayload, size_t length, int copies = 1);
+    // mac of the datagram in pData, its mac field is zeroed
+    void getMac(char* pData, size_t size, uint8_t* pMac) const;
+
+    static const int _commandCopies = 2;
+    static const int _maxSenders = 4;
+    static const int _maxDatagramSize = 1024;
+    static const int _stackBufferSize = 184;
+
+    UdpConnection* _pUdp = nullptr;
+    IPAddress _group;
+    uint16_t _port = 0;
+    uint8_t _key[16];
+
+    uint32_t _senderId = 0;
+    uint32_t _session = 0;
+    uint32_t _nextSeq = 0;
+    bool _firstClock = true;
+
+    SenderState _senders[_maxSenders];
+
+    uint32_t _numReceived = 0;
+    uint32_t _numLost = 0;
+    uint32_t _numDropped = 0;
+    uint32_t _numRejected = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <SmingCore/SmingCore.h>
+#include <Wiring/WVector.h>
+
+/**
+ * In-RAM index of the files served by the webserver, built when the file
+ * system is mounted. Requests are resolved against the index instead of
+ * checking for the plain and the .gz file on SPIFFS each time.
+ *
+ * Every asset has a content hash used as its ETag. After build() a timer
+ * hashes the files one chunk at a time, keeping it out of the boot time and
+ * out of the request handlers. Assets are served without an ETag until they
+ * are hashed. Revalidations (If-None-Match) are answered with 304 from the
+ * index alone.
+ */
+class WebAssets {
+public:
+    struct Asset {
+        String name;        // as requested, without .gz
+        bool gzip = false;
+        uint32_t size = 0;
+        uint32_t hash = 0;
+        bool hashed = false;
+
+        String getFileName() const { return gzip ? name + ".gz" : name; }
+    };
+
+    void build();
+    void clear();
+
+    // nullptr if there is no such asset
+    Asset* find(const String& name);
+    // quoted ETag of the asset, empty until it is hashed
+    String getETag(const Asset& asset) const;
+
+    int count() const { return _assets.count(); }
+
+private:
+    void hashNextChunk();
+    void stopHashing();
+
+    static const int _hashChunkSize = 256;
+    static const int _hashIntervalMs = 10;
+
+    Vector<Asset> _assets;
+
+    // background hashing: asset and open file in progress
+    Timer _hashTimer;
+    unsigned _hashIndex = 0;
+    file_t _hashFile = -1;
+    uint32_t _hash = 0;
+};
@@ -24,6 +24,8 @@
 
 #include <RGBWWLed/RGBWWLedColor.h>
 
+class SharedMessage;
+
 enum API_CODES {
     API_SUCCESS = 0,
     API_BAD_REQUEST = 1,
@@ -44,21 +46,86 @@ public:
 
     String getApiCodeMsg(API_CODES code);
 
+    // event stream of the webapp (websocket on /ws): the JSON messages of the event server
+    void sendEvent(SharedMessage* pMsg);
+    int getNumEventClients() const { return _eventClients.count(); }
+    uint32_t getNumEventsDropped() const { return _numEventsDropped; }
+
+    // request counters and handler times per route
+    void fillRouteStats(JsonArray& routes) const;
+
+    // response bodies, also used by the benchmark
+    IDataSourceStream* createApiCodeResponse(API_CODES code, const String& msg = "");
+    IDataSourceStream* createColorResponse();
+    static IDataSourceStream* createPingResponse();
+
 private:
+    typedef void (ApplicationWebserver::*RouteHandler)(HttpRequest &request, HttpResponse &response);
+
+    enum RouteMethods : uint16_t {
+        MethodGet = 1 << HTTP_GET,
+        MethodPost = 1 << HTTP_POST,
+        MethodAny = 0xFFFF,
+    };
+
+    enum RouteFlags : uint8_t {
+        RouteAuth = 0x01,       // requires authentication if the API is secured
+        RouteBlockOta = 0x02,   // refused while an OTA update runs
+        RoutePage = 0x04,       // answers refusals as text instead of JSON
+    };
+
+    /**
+     * An entry of the routing table. The checks of a route run in the order
+     * heap budget, authentication, OTA, method before its handler is called.
+     * A path may have several entries with different methods.
+     */
+    struct Route {
+        const char* path;
+        uint16_t methods;
+        uint8_t flags;
+        uint16_t minHeap;   // 0: no heap check
+        RouteHandler handler;
+    };
+
+    struct RouteStats {
+        uint32_t count = 0;     // requests passed to the handler
+        uint32_t rejected = 0;  // requests refused by the checks
+        uint32_t totalUs = 0;
+        uint32_t maxUs = 0;
+    };
+
+    static const Route _routes[];
+    static const int _numRoutes;
+    // everything else is looked up in the file system
+    static const Route _fileRoute;
+    static const int _maxRoutes = 24;
 
     bool _init = false;
     bool _running = false;
-    uint _minimumHeap = 8000;
+    static const uint _minimumHeap = 8000;
     uint _minimumHeapAccept = 8000;
 
+    // one entry per route, the last one for _fileRoute
+    RouteStats _routeStats[_maxRoutes + 1];
+
+    static const int _maxEventClients = 2;
+    WebsocketResource* _eventResource = nullptr;
+    Vector<WebSocketConnection*> _eventClients;
+    uint32_t _numEventsDropped = 0;
+
+    // last accepted Authorization header, valid for this settings generation
+    String _authAccepted;
+    uint32_t _authGeneration = 0;
+
     bool authenticated(HttpRequest &request, HttpResponse &response);
     bool authenticateExec(HttpRequest &request, HttpResponse &response);
     void onFile(HttpRequest &request, HttpResponse &response);
     void onIndex(HttpRequest &request, HttpResponse &response);
     void onWebapp(HttpRequest &request, HttpResponse &response);
+    // false if there is no such asset
+    bool sendAsset(HttpRequest &request, HttpResponse &response, const String& name, bool revalidate);
     void onConfig(HttpRequest &request, HttpResponse &response);
     void onInfo(HttpRequest &request, HttpResponse &response);
-    void onColor(HttpRequest &request, HttpResponse &response);
     void onAnimation(HttpRequest &request, HttpResponse &response);
     void onNetworks(HttpRequest &request, HttpResponse &response);
     void onScanNetworks(HttpRequest &request, HttpResponse &response);
@@ -67,8 +134,8 @@ private:
     void onConnect(HttpRequest &request, HttpResponse &response);
     void generate204(HttpRequest &request, HttpResponse &response);
     void onPing(HttpRequest &request, HttpResponse &response);
-    void sendApiResponse(HttpResponse &response, JsonObjectStream* stream, int code = 200);
-    void sendApiCode(HttpResponse &response, API_CODES code, String msg = "");
+    void sendApiResponse(HttpResponse &response, IDataSourceStream* stream, int code = 200);
+    void sendApiCode(HttpResponse &response, API_CODES code, String msg = "", int httpCode = 400);
     void onStop(HttpRequest &request, HttpResponse &response);
     void onSkip(HttpRequest &request, HttpResponse &response);
     void onPause(HttpRequest &request, HttpResponse &response);
@@ -80,9 +147,19 @@ private:
     void onColorPost(HttpRequest &request, HttpResponse &response);
     bool onColorPostCmd(JsonObject& root, String& errorMsg);
 
-    bool checkHeap(HttpResponse &response);
+    bool checkHeap(HttpResponse &response, uint minHeap = _minimumHeap);
+
+    void onRequest(HttpRequest &request, HttpResponse &response);
+    bool checkRoute(const Route& route, uint16_t allowed, HttpRequest &request, HttpResponse &response);
+    static uint16_t getMethodMask(HttpMethod method);
+    static String getAllowHeader(uint16_t methods);
+
+    int onEventsHeaders(HttpServerConnection& connection, HttpRequest &request, HttpResponse &response);
+    void onEventsConnected(WebSocketConnection& socket);
+    void onEventsDisconnected(WebSocketConnection& socket);
 
     static bool isPrintable(String& str);
+    static bool isEqualConstantTime(const String& a, const String& b);
 
 };
 